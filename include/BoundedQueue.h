@@ -0,0 +1,66 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#ifndef BAVITH_BOUNDED_QUEUE_H
+#define BAVITH_BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+
+/** Blocking FIFO with a fixed capacity to link pipeline stages.
+ *
+ * push() blocks while the queue is full, pop() while it is empty. After close() pushing fails and pop()
+ * returns std::nullopt once the remaining items are consumed.
+ */
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+    /// @return false if the queue was closed
+    bool push(T item) {
+        std::unique_lock lock(mutex);
+        not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed)
+            return false;
+        items.push_back(std::move(item));
+        lock.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+
+    std::optional<T> pop() {
+        std::unique_lock lock(mutex);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty())
+            return std::nullopt;
+        T item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        not_full.notify_one();
+        return item;
+    }
+
+    void close() {
+        {
+            std::lock_guard lock(mutex);
+            closed = true;
+        }
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+private:
+    const size_t capacity;
+    std::deque<T> items;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+};
+
+#endif //BAVITH_BOUNDED_QUEUE_H
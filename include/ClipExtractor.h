@@ -0,0 +1,66 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#ifndef BAVITH_CLIP_EXTRACTOR_H
+#define BAVITH_CLIP_EXTRACTOR_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "VideoDecoder.h"
+
+extern "C" {
+    #include <libavcodec/bsf.h>
+    #include <libavformat/avformat.h>
+}
+
+
+/** Frame accurate clip extraction without re-encoding the whole clip ("smart cut").
+ *
+ * Only the partial GOPs at the start and end of a clip are decoded and re-encoded (same codec, geometry,
+ * pixel format and profile as the input), all complete GOPs in between are stream-copied. The keyframe
+ * index of the input is built once and reused for every clip.
+ */
+class ClipExtractor: public VideoDecoder {
+public:
+    struct Stats {
+        int64_t encoded_frames = 0;
+        int64_t copied_packets = 0;
+    };
+
+    explicit ClipExtractor(const std::string &filename);
+
+    // Disable copy
+    ClipExtractor(const ClipExtractor&) = delete;
+    ClipExtractor& operator=(const ClipExtractor&) = delete;
+
+    /** Extract the frames in [start, end] (seconds) into a new file
+     *
+     * @return number of re-encoded frames and copied packets
+     */
+    Stats extract(double start, double end, const std::string &output_filename);
+
+private:
+    struct BsfDeleter       { void operator()(AVBSFContext* b)     const { av_bsf_free(&b);             } };
+    struct OutputDeleter    { void operator()(AVFormatContext* f)  const { avio_closep(&f->pb); avformat_free_context(f); } };
+
+    // state of the clip being extracted
+    std::unique_ptr<AVFormatContext, OutputDeleter> output_context;
+    std::unique_ptr<AVBSFContext, BsfDeleter> bsf_context;
+    AVStream *output_stream = nullptr;
+    int64_t clip_start = 0;
+    int64_t last_dts = AV_NOPTS_VALUE;
+    int64_t dts_shift = 0;  // reorder delay of the copied packets (input time base), applied to re-encoded ones
+    Stats stats;
+
+    void open_output(const std::string &output_filename);
+    void write_packet(AVPacket *pkt, AVRational time_base, bool copied);
+    int64_t get_reorder_delay(int64_t key_pts);
+    void encode_segment(int64_t from_pts, int64_t to_pts);
+    /// @return pts of the last copied frame (from_pts - 1 if none)
+    int64_t copy_segment(int64_t from_pts, int64_t to_pts);
+};
+
+#endif //BAVITH_CLIP_EXTRACTOR_H
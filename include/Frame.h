@@ -0,0 +1,203 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#ifndef BAVITH_FRAME_H
+#define BAVITH_FRAME_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+extern "C" {
+    #include <libavutil/frame.h>
+    #include <libavutil/pixfmt.h>
+}
+
+
+// Pixel formats known at compile time
+
+struct YUV420P {
+    static constexpr AVPixelFormat pixel_format = AV_PIX_FMT_YUV420P;
+    static constexpr int planes = 3;
+    static constexpr int log2_chroma_w = 1;
+    static constexpr int log2_chroma_h = 1;
+    static constexpr std::array<int, planes> bytes_per_pixel = {1, 1, 1};
+};
+
+struct NV12 {
+    static constexpr AVPixelFormat pixel_format = AV_PIX_FMT_NV12;
+    static constexpr int planes = 2;
+    static constexpr int log2_chroma_w = 1;
+    static constexpr int log2_chroma_h = 1;
+    static constexpr std::array<int, planes> bytes_per_pixel = {1, 2}; // interleaved UV
+};
+
+struct RGB24 {
+    static constexpr AVPixelFormat pixel_format = AV_PIX_FMT_RGB24;
+    static constexpr int planes = 1;
+    static constexpr int log2_chroma_w = 0;
+    static constexpr int log2_chroma_h = 0;
+    static constexpr std::array<int, planes> bytes_per_pixel = {3};
+};
+
+
+/** View of an AVFrame whose pixel format is known at compile time.
+ *
+ * Plane geometry is constexpr, so copies into/out of packed buffers (the layout of av_image_copy_to_buffer
+ * with align 1) need no runtime layout computation.
+ */
+template<typename Format>
+class Frame {
+public:
+    static constexpr AVPixelFormat pixel_format = Format::pixel_format;
+    static constexpr int planes = Format::planes;
+
+    static constexpr int plane_width(const int plane, const int width) {
+        return plane == 0 ? width : -((-width) >> Format::log2_chroma_w);
+    }
+    static constexpr int plane_height(const int plane, const int height) {
+        return plane == 0 ? height : -((-height) >> Format::log2_chroma_h);
+    }
+    static constexpr int row_bytes(const int plane, const int width) {
+        return plane_width(plane, width) * Format::bytes_per_pixel[plane];
+    }
+    static constexpr size_t plane_size(const int plane, const int width, const int height) {
+        return static_cast<size_t>(row_bytes(plane, width)) * plane_height(plane, height);
+    }
+    static constexpr size_t buffer_size(const int width, const int height) {
+        size_t size = 0;
+        for (int p = 0; p < planes; p++)
+            size += plane_size(p, width, height);
+        return size;
+    }
+
+    explicit Frame(AVFrame *frame) : frame(frame) {}
+
+    int width() const { return frame->width; }
+    int height() const { return frame->height; }
+    uint8_t *plane(const int p) const { return frame->data[p]; }
+    int linesize(const int p) const { return frame->linesize[p]; }
+    AVFrame *get() const { return frame; }
+
+    /// point data/linesize at a packed buffer without copying
+    static void fill_arrays(const uint8_t *buf, uint8_t *data[4], int linesize[4], const int width, const int height) {
+        auto *ptr = const_cast<uint8_t *>(buf);
+        for (int p = 0; p < 4; p++) {
+            if (p < planes) {
+                data[p] = ptr;
+                linesize[p] = row_bytes(p, width);
+                ptr += plane_size(p, width, height);
+            } else {
+                data[p] = nullptr;
+                linesize[p] = 0;
+            }
+        }
+    }
+
+    void copy_to(uint8_t *dst) const {
+        for (int p = 0; p < planes; p++) {
+            copy_plane(dst, row_bytes(p, width()), plane(p), linesize(p), row_bytes(p, width()), plane_height(p, height()));
+            dst += plane_size(p, width(), height());
+        }
+    }
+
+    void copy_from(const uint8_t *src) const {
+        for (int p = 0; p < planes; p++) {
+            copy_plane(plane(p), linesize(p), src, row_bytes(p, width()), row_bytes(p, width()), plane_height(p, height()));
+            src += plane_size(p, width(), height());
+        }
+    }
+
+    static void copy_plane(uint8_t *dst, const int dst_linesize, const uint8_t *src, const int src_linesize,
+                           const int bytes, const int rows) {
+        if (dst_linesize == bytes && src_linesize == bytes) {
+            std::memcpy(dst, src, static_cast<size_t>(bytes) * rows);
+            return;
+        }
+        for (int y = 0; y < rows; y++)
+            std::memcpy(dst + static_cast<ptrdiff_t>(y) * dst_linesize, src + static_cast<ptrdiff_t>(y) * src_linesize, bytes);
+    }
+
+private:
+    AVFrame *frame;
+};
+
+
+/** Convert between frames of compile-time pixel formats (same geometry). */
+template<typename Src, typename Dst>
+void convert(const Frame<Src> &src, const Frame<Dst> &dst) = delete; // unsupported pair
+
+template<typename Format>
+void convert(const Frame<Format> &src, const Frame<Format> &dst) {
+    for (int p = 0; p < Format::planes; p++)
+        Frame<Format>::copy_plane(dst.plane(p), dst.linesize(p), src.plane(p), src.linesize(p),
+                                  Frame<Format>::row_bytes(p, src.width()), Frame<Format>::plane_height(p, src.height()));
+}
+
+template<>
+inline void convert(const Frame<NV12> &src, const Frame<YUV420P> &dst) {
+    Frame<NV12>::copy_plane(dst.plane(0), dst.linesize(0), src.plane(0), src.linesize(0), src.width(), src.height());
+
+    const int chroma_width = Frame<NV12>::plane_width(1, src.width());
+    const int chroma_height = Frame<NV12>::plane_height(1, src.height());
+    for (int y = 0; y < chroma_height; y++) {
+        const uint8_t *uv = src.plane(1) + static_cast<ptrdiff_t>(y) * src.linesize(1);
+        uint8_t *u = dst.plane(1) + static_cast<ptrdiff_t>(y) * dst.linesize(1);
+        uint8_t *v = dst.plane(2) + static_cast<ptrdiff_t>(y) * dst.linesize(2);
+        for (int x = 0; x < chroma_width; x++) {
+            u[x] = uv[2 * x];
+            v[x] = uv[2 * x + 1];
+        }
+    }
+}
+
+template<>
+inline void convert(const Frame<YUV420P> &src, const Frame<NV12> &dst) {
+    Frame<YUV420P>::copy_plane(dst.plane(0), dst.linesize(0), src.plane(0), src.linesize(0), src.width(), src.height());
+
+    const int chroma_width = Frame<YUV420P>::plane_width(1, src.width());
+    const int chroma_height = Frame<YUV420P>::plane_height(1, src.height());
+    for (int y = 0; y < chroma_height; y++) {
+        const uint8_t *u = src.plane(1) + static_cast<ptrdiff_t>(y) * src.linesize(1);
+        const uint8_t *v = src.plane(2) + static_cast<ptrdiff_t>(y) * src.linesize(2);
+        uint8_t *uv = dst.plane(1) + static_cast<ptrdiff_t>(y) * dst.linesize(1);
+        for (int x = 0; x < chroma_width; x++) {
+            uv[2 * x] = u[x];
+            uv[2 * x + 1] = v[x];
+        }
+    }
+}
+
+
+/** Copy kernels for one pixel format and geometry, selected once (e.g. when opening a decoder or encoder).
+ *
+ * Formats without a compile-time specialization fall back to the generic libav image functions.
+ */
+struct FrameKernels {
+    AVPixelFormat pixel_format = AV_PIX_FMT_NONE;
+    int width = 0;
+    int height = 0;
+    size_t buffer_size = 0;
+
+    /// copy a frame into a packed buffer of buffer_size bytes
+    void (*to_buffer)(const FrameKernels &kernels, const AVFrame *src, uint8_t *dst) = nullptr;
+    /// copy a packed buffer into the (allocated) planes of a frame
+    void (*from_buffer)(const FrameKernels &kernels, const uint8_t *src, AVFrame *dst) = nullptr;
+    /// point data/linesize at a packed buffer
+    void (*fill_arrays)(const FrameKernels &kernels, const uint8_t *buf, uint8_t *data[4], int linesize[4]) = nullptr;
+
+    bool is_valid() const { return to_buffer != nullptr; }
+    bool matches(const AVFrame *frame) const {
+        return frame->format == pixel_format && frame->width == width && frame->height == height;
+    }
+};
+
+/** Select the kernels for a pixel format and geometry.
+ *
+ * @return the kernels, is_valid() is false if the format/geometry is not supported
+ */
+FrameKernels get_frame_kernels(AVPixelFormat pixel_format, int width, int height);
+
+#endif //BAVITH_FRAME_H
@@ -0,0 +1,93 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#ifndef BAVITH_FRAME_CACHE_H
+#define BAVITH_FRAME_CACHE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <expected>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "VideoDecoderBase.h"
+
+extern "C" {
+    #include <libavutil/frame.h>
+}
+
+
+/** Random access to decoded frames by index for scrubbing.
+ *
+ * Decoded frames are kept (by reference) in an LRU cache limited by a memory budget. Every frame decoded on
+ * the way to a requested one is cached, so stepping backwards through a GOP decodes it only once. A
+ * background thread prefetches frames ahead in the direction of playback.
+ *
+ * The cache takes over the decoder: it must not be used directly while the cache exists. Frames are matched
+ * to the index by their timestamps, so the decoder has to output frames with pts.
+ *
+ * Cached frames of a decoder with a frame pool hold pool buffers: the cache budget is capped to half of the
+ * pool's budget (the rest is left to the decoder). If the pool still runs out, the cache budget is halved
+ * (least recently used frames are evicted) and decoding restarts from the keyframe.
+ */
+class FrameCache {
+public:
+    struct FrameDeleter { void operator()(AVFrame* f) const { av_frame_free(&f); } };
+    using FramePtr = std::unique_ptr<AVFrame, FrameDeleter>;
+
+    explicit FrameCache(VideoDecoderBase &decoder, size_t memory_budget = size_t{512} << 20, int prefetch_frames = 8);
+    ~FrameCache();
+
+    // Disable copy
+    FrameCache(const FrameCache&) = delete;
+    FrameCache& operator=(const FrameCache&) = delete;
+
+    /** Get the frame at an index (presentation order).
+     *
+     * @return a new reference to the frame or a string on error.
+     */
+    std::expected<FramePtr, std::string> get_frame_at(int64_t index);
+
+    int64_t get_frame_count() const;
+    size_t get_cached_bytes() const;
+
+private:
+    struct Entry {
+        FramePtr frame;
+        size_t bytes = 0;
+        std::list<int64_t>::iterator lru;
+    };
+
+    VideoDecoderBase &decoder;
+    size_t memory_budget;       // lowered if the decoder's frame pool runs out
+    const int prefetch_frames;
+
+    std::unordered_map<int64_t, Entry> entries;
+    std::list<int64_t> lru;     // most recently used first
+    size_t cached_bytes = 0;
+    int64_t last_decoded = -1;  // index of the decoder position
+
+    int64_t current_index = 0;
+    int direction = 1;
+    uint64_t generation = 0;    // bumped on every request, restarts prefetching
+    bool stopping = false;
+    std::atomic<int> pending_requests = 0;  // get_frame_at calls waiting for the lock, prefetching yields to them
+
+    mutable std::mutex mutex;
+    std::condition_variable request;
+    std::thread prefetch_thread;
+
+    int64_t index_of(int64_t pts) const;
+    bool decode_step(int64_t target, bool &seeked);
+    void insert(int64_t index, const AVFrame *frame);
+    void evict(size_t max_bytes);
+    void touch(Entry &entry);
+    void prefetch();
+};
+
+#endif //BAVITH_FRAME_CACHE_H
@@ -0,0 +1,97 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#ifndef BAVITH_FRAME_POOL_H
+#define BAVITH_FRAME_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+extern "C" {
+    #include <libavcodec/avcodec.h>
+    #include <libavutil/buffer.h>
+    #include <libavutil/frame.h>
+}
+
+
+/** Pool of aligned frame buffers shared between decoders and encoders.
+ *
+ * Buffers are bucketed by pixel format and (padded) geometry and recycled through an AVBufferPool per bucket,
+ * so once every bucket is warm no further heap allocation takes place. All planes of a frame live in one
+ * 64-byte aligned block. The total amount of memory held by the pool never exceeds the memory budget. If a
+ * request would exceed it, buckets not used for a while (e.g. of a previous resolution) are released first,
+ * buckets in use are never touched. Requests that still do not fit fail with AVERROR(ENOMEM).
+ *
+ * Decoder buffers are bucketed by their padded geometry, so they are not shared with encoder buffers of the
+ * same format and size, only the budget is.
+ */
+class FramePool {
+public:
+    static constexpr int alignment = 64;
+
+    explicit FramePool(size_t memory_budget = size_t{512} << 20, bool use_hugepages = false);
+    ~FramePool();
+
+    // Disable copy
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    /** Attach pooled buffers to a frame.
+     *
+     * frame->format, frame->width and frame->height have to be set. If a decoder context is given the
+     * geometry is padded as required by the decoder (avcodec_align_dimensions2).
+     *
+     * @return 0 on success, < 0 on error (AVERROR(ENOMEM) if the memory budget is exhausted)
+     */
+    int get_buffer(AVFrame *frame, AVCodecContext *codec_context = nullptr);
+
+    /** Preallocate buffers so that the first frames do not hit the allocator.
+     *
+     * Decoders request padded buffers, pass their codec context (after avcodec_open2) to warm the bucket
+     * they will use, without one the buffers are the ones of an encoder.
+     *
+     * @return 0 on success, < 0 on error (AVERROR(ENOMEM) if count buffers do not fit the budget)
+     */
+    int reserve(AVPixelFormat pixel_format, int width, int height, int count, AVCodecContext *codec_context = nullptr);
+
+    size_t get_allocated_bytes() const;
+    size_t get_memory_budget() const;
+
+    // shared with the buffers handed out, so it outlives the pool if frames are still referenced
+    struct Arena : std::enable_shared_from_this<Arena> {
+        std::atomic<size_t> allocated{0};
+        size_t memory_budget = 0;
+        bool use_hugepages = false;
+    };
+
+private:
+    using Key = std::tuple<int, int, int>; // pixel format, width, height
+
+    struct Bucket {
+        AVBufferPool *pool = nullptr;
+        size_t buffer_size = 0;
+        int linesize[AV_NUM_DATA_POINTERS] = {};
+        size_t offset[AV_NUM_DATA_POINTERS] = {};
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+    // buckets unused for longer are released when the budget is exhausted
+    static constexpr std::chrono::seconds stale_after{1};
+
+    std::shared_ptr<Arena> arena;
+    std::map<Key, Bucket> buckets;
+    mutable std::mutex mutex;
+
+    // both called with the mutex held
+    Bucket *get_bucket(AVPixelFormat pixel_format, int width, int height, int linesize_align);
+    bool release_stale_buckets(std::chrono::steady_clock::time_point now);
+};
+
+#endif //BAVITH_FRAME_POOL_H
@@ -9,6 +9,7 @@
 #include <vector>
 #include <expected>
 #include <memory>
+#include <optional>
 
 #include "VideoDecoderBase.h"
 
@@ -22,7 +23,9 @@ class HWVideoDecoder: public VideoDecoderBase {
 public:
     static AVPixelFormat get_hw_format(AVCodecContext *ctx, const AVPixelFormat *pix_fmts);
 
-    explicit HWVideoDecoder(const std::string &filename, const std::string &device_type);
+    explicit HWVideoDecoder(const std::string &filename, const std::string &device_type,
+                            std::shared_ptr<FramePool> frame_pool = nullptr,
+                            std::optional<LiveOptions> live = std::nullopt);
 
     // Disable copy
     HWVideoDecoder(const HWVideoDecoder&) = delete;
@@ -0,0 +1,108 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#ifndef BAVITH_PARALLEL_ENCODER_H
+#define BAVITH_PARALLEL_ENCODER_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Frame.h"
+#include "FramePool.h"
+
+extern "C" {
+    #include <libavformat/avformat.h>
+    #include <libavcodec/avcodec.h>
+    #include <libavutil/imgutils.h>
+}
+
+
+/** Encoder splitting the input into closed-GOP chunks which are encoded concurrently.
+ *
+ * Every chunk gets its own encoder context, so it starts with a keyframe and never references frames of
+ * another chunk. Frames keep their global pts, so the packets of consecutive chunks can be muxed one after
+ * the other into a single stream with continuous timestamps.
+ *
+ * Chunks keep their raw frames until they are encoded: the chunk being filled, the queued ones and the ones
+ * being encoded. Together they stay within memory_budget (capped to the frame pool's budget if one is given),
+ * which is the memory cost of the encoder on top of the packets of finished chunks. The chunk size and the
+ * number of workers are reduced to fit it, at least two GOPs have to fit.
+ */
+class ParallelVideoEncoder {
+public:
+    ParallelVideoEncoder(
+        const std::string &filename,
+        int width, int height,
+        AVRational fps = {25, 1},
+        AVPixelFormat pixelFormat = AV_PIX_FMT_YUV420P,
+        int chunk_size = 240,
+        unsigned workers = 0,
+        std::shared_ptr<FramePool> frame_pool = nullptr,
+        size_t memory_budget = size_t{1} << 30);
+    ~ParallelVideoEncoder();
+
+    // Disable copy
+    ParallelVideoEncoder(const ParallelVideoEncoder&) = delete;
+    ParallelVideoEncoder& operator=(const ParallelVideoEncoder&) = delete;
+
+    void encode_frame(const std::vector<uint8_t> &image_buf);
+
+    /** Encode the remaining frames and write the trailer
+     *
+     * called by the destructor if not called before.
+     */
+    void finish();
+
+private:
+    struct PktDeleter   { void operator()(AVPacket* p)       const { av_packet_free(&p);       } };
+    struct FrameDeleter { void operator()(AVFrame* f)        const { av_frame_free(&f);        } };
+    struct CtxDeleter   { void operator()(AVCodecContext* c) const { avcodec_free_context(&c); } };
+
+    struct Chunk {
+        std::vector<std::unique_ptr<AVFrame, FrameDeleter>> frames;
+        std::vector<std::unique_ptr<AVPacket, PktDeleter>> packets;
+        std::string error;
+        bool done = false;
+    };
+
+    AVFormatContext *output_context = nullptr;
+    const AVCodec *video_codec = nullptr;
+    AVStream* stream = nullptr;
+    const AVPixelFormat pixelFormat;
+    std::shared_ptr<FramePool> frame_pool;
+    FrameKernels frame_kernels;
+    const AVRational time_base;
+    const int width;
+    const int height;
+    const int gop_size = 12;
+    int chunk_size;
+    int encoder_threads = 1;
+    int64_t next_pts = 0;
+    bool finished = false;
+
+    std::unique_ptr<Chunk> current_chunk;
+    std::deque<std::shared_ptr<Chunk>> in_flight;   // submission order, written from the front
+    std::deque<std::shared_ptr<Chunk>> pending;     // waiting for a worker
+    size_t encoding_chunks = 0;     // submitted but not encoded yet, these hold raw frames
+    size_t max_encoding_chunks = 0;
+    size_t max_encoded_chunks = 0;  // encoded but not written yet (waiting for an earlier chunk), only packets
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable chunk_done;
+    std::vector<std::thread> worker_threads;
+
+    std::unique_ptr<AVCodecContext, CtxDeleter> open_encoder_context(int thread_count) const;
+    void submit_chunk();
+    void write_chunks(bool wait_all);
+    void encode_chunk(Chunk &chunk) const;
+    void worker();
+};
+
+#endif //BAVITH_PARALLEL_ENCODER_H
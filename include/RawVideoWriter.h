@@ -0,0 +1,101 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#ifndef BAVITH_RAW_VIDEO_WRITER_H
+#define BAVITH_RAW_VIDEO_WRITER_H
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Frame.h"
+
+extern "C" {
+    #include <libavutil/frame.h>
+    #include <libavutil/rational.h>
+}
+
+
+/** Writes uncompressed frames as Y4M or headerless planar video.
+ *
+ * Frames are copied straight from the decoder's planes into the output, either into a memory-mapped,
+ * preallocated window of the file or into a large aligned buffer that is written in batches.
+ */
+class RawVideoWriter {
+public:
+    enum class Container { Y4M, RAW };
+    enum class Output { MMAP, WRITE };
+
+    RawVideoWriter(
+        const std::string &filename,
+        int width, int height,
+        AVRational fps = {25, 1},
+        AVPixelFormat pixelFormat = AV_PIX_FMT_YUV420P,
+        Container container = Container::Y4M,
+        Output output = Output::MMAP);
+    ~RawVideoWriter();
+
+    // Disable copy
+    RawVideoWriter(const RawVideoWriter&) = delete;
+    RawVideoWriter& operator=(const RawVideoWriter&) = delete;
+
+    /// write a frame from its planes (e.g. decoder.get_frame()), format and geometry have to match
+    void write_frame(const AVFrame *frame);
+
+    /// write a packed frame (e.g. decoder.get_frame_vector())
+    void write_frame(const std::vector<uint8_t> &image_buf);
+
+    /// flush and trim the file, called by the destructor if not called before
+    void close();
+
+    int64_t get_frame_count() const;
+
+private:
+    struct FreeDeleter { void operator()(uint8_t* p) const { std::free(p); } };
+
+    // owns a file descriptor
+    class FileDescriptor {
+    public:
+        FileDescriptor() = default;
+        ~FileDescriptor() { reset(); }
+        FileDescriptor(const FileDescriptor&) = delete;
+        FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+        int get() const { return fd; }
+        /// close the current descriptor (if any) and take over fd
+        void reset(int fd = -1);
+    private:
+        int fd = -1;
+    };
+
+    static constexpr size_t mmap_window = size_t{256} << 20;
+    static constexpr size_t write_batch = size_t{16} << 20;
+    static constexpr size_t page_size = 4096;
+    static constexpr char frame_header[] = "FRAME\n";
+
+    const Container container;
+    const Output output;
+    FrameKernels frame_kernels;
+    FileDescriptor fd;
+    size_t position = 0;        // bytes written (committed) to the file
+    int64_t frame_count = 0;
+
+    // Output::MMAP
+    uint8_t *map = nullptr;
+    size_t map_offset = 0;
+    size_t map_size = 0;
+
+    // Output::WRITE
+    std::unique_ptr<uint8_t, FreeDeleter> batch;
+    size_t batch_capacity = 0;
+    size_t batch_size = 0;
+
+    uint8_t *reserve(size_t bytes);
+    uint8_t *begin_frame();
+    void remap(size_t bytes);
+    void flush_batch();
+};
+
+#endif //BAVITH_RAW_VIDEO_WRITER_H
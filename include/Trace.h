@@ -0,0 +1,66 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#ifndef BAVITH_TRACE_H
+#define BAVITH_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+
+/** Timeline tracing of the pipeline stages, exported as Chrome trace event JSON (Perfetto, chrome://tracing).
+ *
+ * Spans are recorded into a lock-free ring buffer per thread (the oldest spans are overwritten), allocated when
+ * the thread records its first span and reused by another thread once it exits. Tracing is switched at runtime,
+ * when disabled a span costs one relaxed atomic load and nothing is allocated.
+ */
+class Trace {
+public:
+    /// start recording, spans recorded before are not exported
+    static void enable();
+    static void disable();
+    static bool is_enabled() { return enabled.load(std::memory_order_relaxed); }
+
+    /// name of the calling thread in the exported timeline (cheap, also when tracing is disabled)
+    static void set_thread_name(const std::string &name);
+    static std::string get_thread_name();
+
+    static std::string to_json();
+    /// @return false if the file could not be written
+    static bool write_json(const std::string &filename);
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /// name has to be a string literal (only the pointer is stored)
+    static void record(const char *name, int64_t start, int64_t end);
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+
+/** Records the lifetime of the object as a span, if tracing is enabled. */
+class TraceSpan {
+public:
+    explicit TraceSpan(const char *name) : name(Trace::is_enabled() ? name : nullptr), start(this->name ? Trace::now() : 0) {}
+    ~TraceSpan() {
+        if (name)
+            Trace::record(name, start, Trace::now());
+    }
+
+    // Disable copy
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char *name;
+    int64_t start;
+};
+
+#endif //BAVITH_TRACE_H
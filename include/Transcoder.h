@@ -0,0 +1,101 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#ifndef BAVITH_TRANSCODER_H
+#define BAVITH_TRANSCODER_H
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BoundedQueue.h"
+#include "FramePool.h"
+#include "VideoDecoderBase.h"
+#include "encoder.h"
+
+extern "C" {
+    #include <libavutil/frame.h>
+    #include <libswscale/swscale.h>
+}
+
+
+/** Decode -> convert -> encode pipeline, one thread per stage.
+ *
+ * Frames are passed as refcounted AVFrames through bounded queues, no frame is copied unless the
+ * decoder output has to be converted to the encoder's pixel format/geometry. Timestamps are rescaled
+ * from the decoder to the encoder time base. Like constant frame rate output, a frame that ends up on the
+ * timestamp of the previous one (variable frame rate input above the encoder frame rate) is dropped and
+ * counted, see get_dropped_frames().
+ */
+class Transcoder {
+public:
+    struct StageStats {
+        std::string name;
+        int64_t frames = 0;
+        double busy_time = 0.0;     // seconds spent working (not waiting on the queues)
+        double utilization = 0.0;   // busy_time / wall time of the run
+    };
+
+    Transcoder(VideoDecoderBase &decoder, VideoEncoder &encoder,
+               size_t queue_size = 8, std::shared_ptr<FramePool> frame_pool = nullptr);
+    ~Transcoder();
+
+    // Disable copy
+    Transcoder(const Transcoder&) = delete;
+    Transcoder& operator=(const Transcoder&) = delete;
+
+    /** Run the pipeline until the decoder is at the end of the stream
+     *
+     * @param max_frames stop after this many decoded frames (< 0 for all)
+     * @return number of encoded frames
+     */
+    int64_t run(int64_t max_frames = -1);
+
+    /// per stage utilization of the last run, the stage closest to 1.0 is the bottleneck
+    std::vector<StageStats> get_stage_stats() const;
+
+    /// frames of the last run dropped because they collided with the previous frame in the encoder time base
+    int64_t get_dropped_frames() const;
+
+private:
+    struct FrameDeleter { void operator()(AVFrame* f) const { av_frame_free(&f); } };
+    using FramePtr = std::unique_ptr<AVFrame, FrameDeleter>;
+
+    struct Stage {
+        std::string name;
+        std::atomic<int64_t> frames{0};
+        std::atomic<int64_t> busy_ns{0};
+    };
+
+    VideoDecoderBase &decoder;
+    VideoEncoder &encoder;
+    std::shared_ptr<FramePool> frame_pool;
+    const size_t queue_size;
+
+    Stage decode_stage{"decode"};
+    Stage convert_stage{"convert"};
+    Stage encode_stage{"encode"};
+    std::chrono::steady_clock::duration run_time{};
+
+    SwsContext *sws_context = nullptr;
+    int64_t last_pts = AV_NOPTS_VALUE;
+    int64_t dropped_frames = 0;
+
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    void decode(BoundedQueue<FramePtr> &output, int64_t max_frames);
+    void convert(BoundedQueue<FramePtr> &input, BoundedQueue<FramePtr> &output);
+    int64_t encode(BoundedQueue<FramePtr> &input);
+
+    FramePtr convert_frame(FramePtr src);
+    void set_error();
+};
+
+#endif //BAVITH_TRANSCODER_H
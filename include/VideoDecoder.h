@@ -6,6 +6,8 @@
 #define BAVITH_DECODER_H
 
 #include <expected>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -18,7 +20,8 @@ extern "C" {
 
 class VideoDecoder: public VideoDecoderBase {
 public:
-    explicit VideoDecoder(const std::string &filename);
+    explicit VideoDecoder(const std::string &filename, std::shared_ptr<FramePool> frame_pool = nullptr,
+                          std::optional<LiveOptions> live = std::nullopt);
 
     // Disable copy
     VideoDecoder(const VideoDecoder&) = delete;
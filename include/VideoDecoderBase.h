@@ -9,8 +9,12 @@
 #include <vector>
 #include <expected>
 #include <memory>
+#include <optional>
 #include <string>
 
+#include "Frame.h"
+#include "FramePool.h"
+
 extern "C" {
     #include <libavcodec/avcodec.h>
     #include <libavutil/rational.h>
@@ -21,6 +25,13 @@ extern "C" {
 
 std::string ffmpeg_error(int errnum);
 
+/// Options for live inputs (pipes, FIFOs): minimal probing/buffering and a latency budget
+struct LiveOptions {
+    double max_latency = 0.5;       // seconds behind the stream clock before packets/frames are dropped
+    int64_t probe_size = 32768;     // bytes
+    int64_t analyze_duration = 100000; // microseconds, 0 means the libav default (5 s, 7 s for mpegts)
+};
+
 class VideoDecoderBase {
 public:
     virtual ~VideoDecoderBase() = default;
@@ -30,12 +41,17 @@ public:
     int get_height() const;
     int get_pixel_format() const;
     AVRational get_frame_rate() const;
+    AVRational get_time_base() const;
     double get_duration() const;
     double get_frame_time() const;
     double get_progress() const;
     double get_bitrate() const;
     AVFrame *get_raw_frame() const;
     bool is_end_of_stream() const;
+    bool is_live() const;
+    int64_t get_dropped_frames() const;
+    double get_latency() const;
+    const std::shared_ptr<FramePool> &get_frame_pool() const;
 
     virtual AVFrame* get_frame() = 0;
 
@@ -43,6 +59,26 @@ public:
 
     void seek(double fraction);
 
+    /** Seek to a timestamp in the time base of the video stream
+     *
+     * decodes from the preceding keyframe up to the first frame at target_pts.
+     */
+    void seek_pts(int64_t target_pts);
+
+    /** Seek to the keyframe at or before target_pts without decoding
+     *
+     * the next decode_next_frame() returns the first frame from there.
+     */
+    void seek_keyframe(int64_t target_pts);
+
+    /** Index the timestamps of all video packets
+     *
+     * demuxes the whole input once and rewinds it afterward.
+     */
+    void build_index();
+    const std::vector<int64_t> &get_frame_timestamps() const;
+    const std::vector<int64_t> &get_keyframe_timestamps() const;
+
     /** Decode the next frame
      *
      * demux+decode the next frame of the selected video stream, disregarding all other streams.
@@ -52,7 +88,43 @@ public:
     int decode_next_frame();
 
 protected:
-    explicit VideoDecoderBase(std::string filename) : filename(std::move(filename)) {};
+    explicit VideoDecoderBase(std::string filename, std::shared_ptr<FramePool> frame_pool = nullptr,
+                              std::optional<LiveOptions> live = std::nullopt)
+        : filename(std::move(filename)), frame_pool(std::move(frame_pool)), live(std::move(live)) {};
+
+    /// open the input and select the video stream (with minimal probing in live mode)
+    void open_input();
+
+    /// low delay decoder settings in live mode, call before avcodec_open2
+    void apply_live_codec_options();
+
+    /** Check a timestamp against the live latency budget
+     *
+     * the stream clock is anchored to the wall clock at the earliest observed offset, so bursts at startup
+     * do not count as latency.
+     */
+    bool is_late(int64_t pts);
+
+    /** Live drop policy for the current packet
+     *
+     * lagging: non-reference frames (disposable, or H.264/HEVC in Annex B, e.g. mpegts, by their NAL header)
+     * are dropped before decoding, other late frames after decoding. Far behind (4x max_latency) everything
+     * up to the next keyframe is dropped.
+     */
+    bool drop_packet();
+
+    /** get_buffer2 callback serving decoded frames from the frame pool
+     *
+     * expects decoder_context->opaque to point to the decoder, falls back to the default allocator for
+     * formats the pool cannot serve.
+     */
+    static int get_pooled_buffer(AVCodecContext *ctx, AVFrame *frame, int flags);
+
+    /** Copy a cpu frame into a packed std::vector
+     *
+     * uses the kernels selected for the stream, they are only re-selected if format or geometry change.
+     */
+    std::expected<std::vector<uint8_t>, std::string> copy_frame_to_vector(const AVFrame *src);
 
     struct PktDeleter     { void operator()(AVPacket* p)        const { av_packet_free(&p);       } };
     struct FrameDeleter   { void operator()(AVFrame* f)         const { av_frame_free(&f);        } };
@@ -65,14 +137,28 @@ protected:
     std::unique_ptr<AVFrame, FrameDeleter> frame;
 
     std::string filename;
+    std::shared_ptr<FramePool> frame_pool;
+    FrameKernels frame_kernels;
     const AVCodec* decoder = nullptr;
     AVStream* video_stream = nullptr;
 
+    // presentation order, filled by build_index()
+    std::vector<int64_t> frame_timestamps;
+    std::vector<int64_t> keyframe_timestamps;
+
     bool end_of_stream = false;
     int64_t frame_pts = 0;
     int64_t video_frame_count = 0;
     double duration = 0.0;
 
+    std::optional<LiveOptions> live;
+    int64_t dropped_frames = 0;
+    double latency = 0.0;
+    double clock_offset = 0.0;
+    bool clock_started = false;
+    bool skip_to_keyframe = false;
+    int64_t frames_in_decoder = 0;  // packets sent but not received as frames yet
+
     std::deque<std::pair<int64_t, int>> bitrate_window;
     const size_t max_bitrate_window = 32;
 };
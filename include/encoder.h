@@ -5,9 +5,13 @@
 #ifndef BAVITH_ENCODER_H
 #define BAVITH_ENCODER_H
 
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "Frame.h"
+#include "FramePool.h"
+
 extern "C" {
     #include <libavformat/avformat.h>
     #include <libavcodec/avcodec.h>
@@ -25,6 +29,8 @@ class VideoEncoder {
     AVFrame* frame = nullptr;
     AVPacket* packet = nullptr;
     AVStream* stream = nullptr;
+    std::shared_ptr<FramePool> frame_pool;
+    FrameKernels frame_kernels;
     int64_t next_pts = 0;
     int64_t frame_index = 0;
     int height = 0;
@@ -35,13 +41,28 @@ public:
         const std::string &filename,
         int width, int height,
         AVRational fps = {25, 1},
-        AVPixelFormat pixelFormat = AV_PIX_FMT_YUV420P);
+        AVPixelFormat pixelFormat = AV_PIX_FMT_YUV420P,
+        std::shared_ptr<FramePool> frame_pool = nullptr);
     ~VideoEncoder();
 
     void encode_frame(const std::vector<uint8_t> &image_buf);
 
+    /** Encode a refcounted frame without copying it.
+     *
+     * The frame has to match the encoder's pixel format and geometry, its pts is taken as is
+     * (in the encoder time base 1/fps, see get_time_base()).
+     */
+    void encode_frame(const AVFrame *av_frame);
+
+    int get_width() const;
+    int get_height() const;
+    AVPixelFormat get_pixel_format() const;
+    AVRational get_time_base() const;
+
 private:
     void _gen_frame();
+    void _get_frame_buffer();
+    void _write_packets();
     void flush_encoder();
     void encode_frame_synthetic();
 };
@@ -5,6 +5,7 @@
 #include "include/VideoDecoder.h"
 #include "include/HWVideoDecoder.h"
 #include "include/encoder.h"
+#include "include/Transcoder.h"
 
 void save_pgm(const std::vector<uint8_t>& data, int width, int height, const std::string& filename) {
     std::ofstream file(filename, std::ios::binary);
@@ -43,26 +44,21 @@ int main(int argc, char* argv[]) {
 
     VideoEncoder encoder(filename_dst, decoder.get_width(), decoder.get_height(), decoder.get_frame_rate());
 
-    int i = 0;
-    while (true) {
-        if (i > 120) break; // stop at frame 120
+    // decode, convert and encode on separate threads, stop at frame 120
+    Transcoder transcoder(decoder, encoder);
+    const int64_t frames = transcoder.run(121);
+    std::cout << "frames: " << frames << " (dropped: " << transcoder.get_dropped_frames() << ")" << std::endl;
 
-        if (decoder.decode_next_frame()) {
-            std::cout << "EOF" << std::endl;
-            break;
-        }
-        std::cout << "frame: " + std::to_string(i++) << std::endl;
+    for (const auto &stage: transcoder.get_stage_stats())
+        std::cout << stage.name << ": " << stage.utilization * 100.0 << "% busy" << std::endl;
 
-        if (auto res = decoder.get_frame_vector()) {
-            // do sth with value
-            // save_pgm(res.value(), decoder.get_width(), decoder.get_height(), "frame" + std::to_string(i) + ".pgm");
-            encoder.encode_frame(res.value());
-            // std::cout << "frame: " + std::to_string(i) << std::endl;
-            // i++;
-        } else {
-            std::cout << res.error() << std::endl;
-        }
-    }
+    // or frame by frame through cpu memory:
+    // while (decoder.decode_next_frame() == 0) {
+    //     if (auto res = decoder.get_frame_vector()) {
+    //         // save_pgm(res.value(), decoder.get_width(), decoder.get_height(), "frame.pgm");
+    //         encoder.encode_frame(res.value());
+    //     }
+    // }
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,265 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#include "../include/ClipExtractor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+ClipExtractor::ClipExtractor(const std::string &filename) : VideoDecoder(filename) {
+    // the index is shared by all clips of this input
+    build_index();
+}
+
+ClipExtractor::Stats ClipExtractor::extract(const double start, const double end, const std::string &output_filename) {
+    if (end < start)
+        throw std::runtime_error("Invalid clip range");
+
+    const double time_base = av_q2d(video_stream->time_base);
+    const auto first = std::ranges::lower_bound(frame_timestamps, std::llround(start / time_base));
+    const auto last = std::ranges::upper_bound(frame_timestamps, std::llround(end / time_base));
+    if (first >= last)
+        throw std::runtime_error("No frames in clip range");
+
+    const int64_t start_pts = *first;
+    const int64_t end_pts = *(last - 1);
+
+    // find the complete GOPs inside the clip
+    int64_t copy_start = AV_NOPTS_VALUE;
+    int64_t copy_end = AV_NOPTS_VALUE;
+    for (auto key = std::ranges::lower_bound(keyframe_timestamps, start_pts); key != keyframe_timestamps.end(); ++key) {
+        const int64_t gop_end = (key + 1 != keyframe_timestamps.end()) ? *(key + 1) : INT64_MAX;
+        const int64_t gop_last_frame = *(std::ranges::lower_bound(frame_timestamps, gop_end) - 1);
+        if (gop_last_frame > end_pts)
+            break;
+
+        if (copy_start == AV_NOPTS_VALUE)
+            copy_start = *key;
+        copy_end = gop_end;
+    }
+
+    clip_start = start_pts;
+    open_output(output_filename);
+    dts_shift = copy_start != AV_NOPTS_VALUE ? get_reorder_delay(copy_start) : 0;
+
+    if (copy_start == AV_NOPTS_VALUE) {
+        // clip lies within a single GOP
+        encode_segment(start_pts, end_pts + 1);
+    } else {
+        if (start_pts < copy_start)
+            encode_segment(start_pts, copy_start);
+        const int64_t last_copied = copy_segment(copy_start, copy_end);
+
+        // leading pictures of an open GOP at copy_end follow its keyframe in decode order and were not copied,
+        // re-encode from the first frame after the copied ones
+        const auto next = std::ranges::upper_bound(frame_timestamps, last_copied);
+        if (next != frame_timestamps.end() && *next <= end_pts)
+            encode_segment(*next, end_pts + 1);
+    }
+
+    if (av_write_trailer(output_context.get()) < 0)
+        throw std::runtime_error("failed to write trailer");
+    output_context.reset();
+    bsf_context.reset();
+
+    return stats;
+}
+
+void ClipExtractor::open_output(const std::string &output_filename) {
+    stats = {};
+    last_dts = AV_NOPTS_VALUE;
+
+    // guess output format based on filename
+    AVFormatContext *raw_output_context = nullptr;
+    if (avformat_alloc_output_context2(&raw_output_context, nullptr, nullptr, output_filename.c_str()) < 0 || !raw_output_context)
+        throw std::runtime_error("failed to create output context (unable to guess output format)");
+    output_context.reset(raw_output_context);
+
+    // copied keyframes need their parameter sets in-band, the re-encoded frames before them bring their own
+    const AVCodecID codec_id = video_stream->codecpar->codec_id;
+    const char *bsf_name = codec_id == AV_CODEC_ID_H264 ? "h264_mp4toannexb"
+                         : codec_id == AV_CODEC_ID_HEVC ? "hevc_mp4toannexb"
+                         : "dump_extra";
+    const AVBitStreamFilter *filter = av_bsf_get_by_name(bsf_name);
+    if (!filter)
+        filter = av_bsf_get_by_name("null");
+
+    AVBSFContext *raw_bsf_context = nullptr;
+    if (av_bsf_alloc(filter, &raw_bsf_context) < 0)
+        throw std::runtime_error("failed to allocate bitstream filter");
+    bsf_context.reset(raw_bsf_context);
+
+    if (avcodec_parameters_copy(bsf_context->par_in, video_stream->codecpar) < 0)
+        throw std::runtime_error("failed to copy codec parameters");
+    bsf_context->time_base_in = video_stream->time_base;
+    if (av_bsf_init(bsf_context.get()) < 0)
+        throw std::runtime_error("failed to initialize bitstream filter");
+
+    output_stream = avformat_new_stream(output_context.get(), nullptr);
+    if (!output_stream)
+        throw std::runtime_error("failed to allocate output stream");
+
+    if (avcodec_parameters_copy(output_stream->codecpar, bsf_context->par_out) < 0)
+        throw std::runtime_error("failed to copy codec parameters");
+    output_stream->codecpar->codec_tag = 0;
+    output_stream->time_base = video_stream->time_base;
+
+    // open output file
+    if (!(output_context->oformat->flags & AVFMT_NOFILE) &&
+        avio_open(&output_context->pb, output_filename.c_str(), AVIO_FLAG_WRITE) < 0)
+        throw std::runtime_error("failed to open output");
+
+    // write header to file
+    if (avformat_write_header(output_context.get(), nullptr) < 0)
+        throw std::runtime_error("failed to write header");
+}
+
+int64_t ClipExtractor::get_reorder_delay(const int64_t key_pts) {
+    seek_keyframe(key_pts);
+
+    std::unique_ptr<AVPacket, PktDeleter> pkt(av_packet_alloc());
+    if (!pkt) throw std::runtime_error("Failed to allocate AVPacket");
+
+    // the keyframe is presented that much after it is decoded
+    int64_t delay = 0;
+    while (av_read_frame(format_context.get(), pkt.get()) >= 0) {
+        const bool found = pkt->stream_index == video_stream->index;
+        if (found && pkt->pts != AV_NOPTS_VALUE && pkt->dts != AV_NOPTS_VALUE)
+            delay = std::max<int64_t>(0, pkt->pts - pkt->dts);
+        av_packet_unref(pkt.get());
+        if (found)
+            break;
+    }
+    return delay;
+}
+
+void ClipExtractor::write_packet(AVPacket *pkt, const AVRational time_base, const bool copied) {
+    // timestamps relative to the clip start
+    const int64_t offset = av_rescale_q(clip_start, video_stream->time_base, time_base);
+    if (pkt->pts != AV_NOPTS_VALUE) pkt->pts -= offset;
+    if (pkt->dts != AV_NOPTS_VALUE) pkt->dts -= offset;
+    av_packet_rescale_ts(pkt, time_base, output_stream->time_base);
+    pkt->stream_index = output_stream->index;
+
+    // the re-encoded frames have no reorder delay, give them the one of the copied packets so dts keeps
+    // increasing at the junctions (the timestamps of copied packets are never changed)
+    if (!copied && pkt->dts != AV_NOPTS_VALUE)
+        pkt->dts -= av_rescale_q(dts_shift, video_stream->time_base, output_stream->time_base);
+
+    // irregular delays, only move dts as far as the pts allows
+    if (pkt->dts != AV_NOPTS_VALUE && last_dts != AV_NOPTS_VALUE && pkt->dts <= last_dts) {
+        if (pkt->pts != AV_NOPTS_VALUE && pkt->pts <= last_dts)
+            throw std::runtime_error("non-monotonic timestamps at a segment junction");
+        pkt->dts = last_dts + 1;
+    }
+    if (pkt->dts != AV_NOPTS_VALUE)
+        last_dts = pkt->dts;
+
+    if (av_interleaved_write_frame(output_context.get(), pkt) < 0)
+        throw std::runtime_error("failed to write frame");
+}
+
+void ClipExtractor::encode_segment(const int64_t from_pts, const int64_t to_pts) {
+    const AVCodec *encoder = avcodec_find_encoder(video_stream->codecpar->codec_id);
+    if (!encoder)
+        throw std::runtime_error("no encoder for the input codec");
+
+    std::unique_ptr<AVCodecContext, CtxDeleter> encoder_context(avcodec_alloc_context3(encoder));
+    if (!encoder_context)
+        throw std::runtime_error("failed to allocate encoder context");
+
+    // match the stream that is copied around the re-encoded frames
+    encoder_context->width = decoder_context->width;
+    encoder_context->height = decoder_context->height;
+    encoder_context->pix_fmt = decoder_context->pix_fmt;
+    encoder_context->sample_aspect_ratio = decoder_context->sample_aspect_ratio;
+    encoder_context->color_range = decoder_context->color_range;
+    encoder_context->color_primaries = decoder_context->color_primaries;
+    encoder_context->color_trc = decoder_context->color_trc;
+    encoder_context->colorspace = decoder_context->colorspace;
+    encoder_context->chroma_sample_location = decoder_context->chroma_sample_location;
+    encoder_context->profile = video_stream->codecpar->profile;
+    encoder_context->level = video_stream->codecpar->level;
+    encoder_context->bit_rate = video_stream->codecpar->bit_rate;
+    encoder_context->framerate = video_stream->avg_frame_rate;
+    encoder_context->max_b_frames = 0;
+    encoder_context->time_base = video_stream->time_base;
+    if (encoder_context->time_base.den > 65535 && video_stream->avg_frame_rate.num > 0)
+        encoder_context->time_base = av_inv_q(video_stream->avg_frame_rate); // e.g. MPEG-4 part 2 limits the time base
+    // no global header: parameter sets go in-band, the stream extradata belongs to the copied packets
+
+    if (avcodec_open2(encoder_context.get(), encoder, nullptr) < 0)
+        throw std::runtime_error("failed to open encoder");
+
+    std::unique_ptr<AVPacket, PktDeleter> pkt(av_packet_alloc());
+    if (!pkt) throw std::runtime_error("Failed to allocate AVPacket");
+
+    auto receive_packets = [&] {
+        while (avcodec_receive_packet(encoder_context.get(), pkt.get()) == 0) {
+            write_packet(pkt.get(), encoder_context->time_base, false);
+            av_packet_unref(pkt.get());
+        }
+    };
+
+    seek_pts(from_pts);
+    while (frame_pts < to_pts) {
+        if (frame_pts >= from_pts) {
+            frame->pts = av_rescale_q(frame_pts, video_stream->time_base, encoder_context->time_base);
+            frame->pict_type = AV_PICTURE_TYPE_NONE;
+            if (avcodec_send_frame(encoder_context.get(), frame.get()) < 0)
+                throw std::runtime_error("failed to send frame");
+            receive_packets();
+            stats.encoded_frames++;
+        }
+        if (decode_next_frame() < 0)
+            break;
+    }
+
+    // flush encoder
+    const int ret = avcodec_send_frame(encoder_context.get(), nullptr);
+    if (ret < 0 && ret != AVERROR_EOF)
+        throw std::runtime_error("flushing encoder failed");
+    receive_packets();
+}
+
+int64_t ClipExtractor::copy_segment(const int64_t from_pts, const int64_t to_pts) {
+    seek_keyframe(from_pts);
+    int64_t last_copied = from_pts - 1;
+
+    std::unique_ptr<AVPacket, PktDeleter> pkt(av_packet_alloc());
+    if (!pkt) throw std::runtime_error("Failed to allocate AVPacket");
+
+    while (av_read_frame(format_context.get(), pkt.get()) >= 0) {
+        if (pkt->stream_index != video_stream->index) {
+            av_packet_unref(pkt.get());
+            continue;
+        }
+        // packets without pts (e.g. elementary streams in TS) are copied too, dts bounds their position (pts >= dts)
+        const bool has_pts = pkt->pts != AV_NOPTS_VALUE;
+        const int64_t position = has_pts ? pkt->pts : pkt->dts;
+
+        // stop at the keyframe of the first GOP that is not copied
+        if (pkt->flags & AV_PKT_FLAG_KEY && position != AV_NOPTS_VALUE && position >= to_pts) {
+            av_packet_unref(pkt.get());
+            break;
+        }
+        // leading pictures of an open GOP reference frames before the clip
+        if (has_pts && pkt->pts < from_pts) {
+            av_packet_unref(pkt.get());
+            continue;
+        }
+
+        if (has_pts)
+            last_copied = std::max(last_copied, pkt->pts);
+        if (av_bsf_send_packet(bsf_context.get(), pkt.get()) < 0)
+            throw std::runtime_error("failed to filter packet");
+        while (av_bsf_receive_packet(bsf_context.get(), pkt.get()) == 0) {
+            write_packet(pkt.get(), video_stream->time_base, true);
+            av_packet_unref(pkt.get());
+            stats.copied_packets++;
+        }
+    }
+    return last_copied;
+}
@@ -0,0 +1,69 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#include "../include/Frame.h"
+
+extern "C" {
+    #include <libavutil/imgutils.h>
+}
+
+namespace {
+    template<typename Format>
+    FrameKernels make_kernels(const int width, const int height) {
+        FrameKernels kernels;
+        kernels.pixel_format = Format::pixel_format;
+        kernels.width = width;
+        kernels.height = height;
+        kernels.buffer_size = Frame<Format>::buffer_size(width, height);
+        kernels.to_buffer = [](const FrameKernels &, const AVFrame *src, uint8_t *dst) {
+            Frame<Format>(const_cast<AVFrame *>(src)).copy_to(dst);
+        };
+        kernels.from_buffer = [](const FrameKernels &, const uint8_t *src, AVFrame *dst) {
+            Frame<Format>(dst).copy_from(src);
+        };
+        kernels.fill_arrays = [](const FrameKernels &k, const uint8_t *buf, uint8_t *data[4], int linesize[4]) {
+            Frame<Format>::fill_arrays(buf, data, linesize, k.width, k.height);
+        };
+        return kernels;
+    }
+
+    FrameKernels make_generic_kernels(const AVPixelFormat pixel_format, const int width, const int height) {
+        FrameKernels kernels;
+        const int buf_size = av_image_get_buffer_size(pixel_format, width, height, 1);
+        if (buf_size < 0)
+            return kernels;
+
+        kernels.pixel_format = pixel_format;
+        kernels.width = width;
+        kernels.height = height;
+        kernels.buffer_size = buf_size;
+        kernels.to_buffer = [](const FrameKernels &k, const AVFrame *src, uint8_t *dst) {
+            av_image_copy_to_buffer(dst, static_cast<int>(k.buffer_size), src->data, src->linesize,
+                                    k.pixel_format, k.width, k.height, 1);
+        };
+        kernels.from_buffer = [](const FrameKernels &k, const uint8_t *src, AVFrame *dst) {
+            uint8_t *src_data[4];
+            int src_linesize[4];
+            av_image_fill_arrays(src_data, src_linesize, src, k.pixel_format, k.width, k.height, 1);
+            av_image_copy(dst->data, dst->linesize, const_cast<const uint8_t **>(src_data), src_linesize,
+                          k.pixel_format, k.width, k.height);
+        };
+        kernels.fill_arrays = [](const FrameKernels &k, const uint8_t *buf, uint8_t *data[4], int linesize[4]) {
+            av_image_fill_arrays(data, linesize, buf, k.pixel_format, k.width, k.height, 1);
+        };
+        return kernels;
+    }
+}
+
+FrameKernels get_frame_kernels(const AVPixelFormat pixel_format, const int width, const int height) {
+    if (width <= 0 || height <= 0)
+        return {};
+
+    switch (pixel_format) {
+        case AV_PIX_FMT_YUV420P: return make_kernels<YUV420P>(width, height);
+        case AV_PIX_FMT_NV12:    return make_kernels<NV12>(width, height);
+        case AV_PIX_FMT_RGB24:   return make_kernels<RGB24>(width, height);
+        default:                 return make_generic_kernels(pixel_format, width, height);
+    }
+}
@@ -0,0 +1,216 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#include "../include/FrameCache.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+FrameCache::FrameCache(VideoDecoderBase &decoder, const size_t memory_budget, const int prefetch_frames)
+    : decoder(decoder),
+      memory_budget(decoder.get_frame_pool() ? std::min(memory_budget, decoder.get_frame_pool()->get_memory_budget() / 2)
+                                             : memory_budget),
+      prefetch_frames(prefetch_frames) {
+    if (decoder.get_frame_timestamps().empty()) {
+        // indexing rewinds the decoder to the first frame
+        decoder.build_index();
+        last_decoded = -1;
+    } else {
+        // unknown position, the first request seeks
+        last_decoded = std::numeric_limits<int64_t>::max();
+    }
+
+    prefetch_thread = std::thread(&FrameCache::prefetch, this);
+}
+
+FrameCache::~FrameCache() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    request.notify_all();
+    prefetch_thread.join();
+}
+
+int64_t FrameCache::get_frame_count() const { return static_cast<int64_t>(decoder.get_frame_timestamps().size()); }
+
+size_t FrameCache::get_cached_bytes() const {
+    std::lock_guard lock(mutex);
+    return cached_bytes;
+}
+
+std::expected<FrameCache::FramePtr, std::string> FrameCache::get_frame_at(const int64_t index) {
+    if (index < 0 || index >= get_frame_count())
+        return std::unexpected("Frame index out of range");
+
+    // std::mutex is not fair, make prefetching step aside until we have the lock
+    pending_requests++;
+    std::unique_lock lock(mutex);
+    if (--pending_requests == 0)
+        request.notify_all();
+
+    if (index != current_index)
+        direction = index > current_index ? 1 : -1;
+    current_index = index;
+    generation++;
+
+    if (!entries.contains(index)) {
+        bool seeked = false;
+        try {
+            while (!entries.contains(index)) {
+                if (!decode_step(index, seeked))
+                    return std::unexpected("Failed to decode frame");
+            }
+        } catch (const std::exception &e) {
+            return std::unexpected(e.what());
+        }
+    }
+
+    Entry &entry = entries.at(index);
+    touch(entry);
+    FramePtr frame(av_frame_clone(entry.frame.get()));
+    if (!frame)
+        return std::unexpected("Failed to reference AVFrame");
+
+    lock.unlock();
+    request.notify_all();
+    return frame;
+}
+
+int64_t FrameCache::index_of(const int64_t pts) const {
+    const auto &timestamps = decoder.get_frame_timestamps();
+    const auto it = std::ranges::lower_bound(timestamps, pts);
+    if (it == timestamps.end() || *it != pts)
+        return -1;
+    return it - timestamps.begin();
+}
+
+bool FrameCache::decode_step(const int64_t target, bool &seeked) {
+    const auto &keyframes = decoder.get_keyframe_timestamps();
+    const int64_t target_pts = decoder.get_frame_timestamps()[target];
+
+    // keyframe starting the GOP of the target
+    auto key = std::ranges::upper_bound(keyframes, target_pts);
+    if (key != keyframes.begin())
+        --key;
+    const int64_t key_index = index_of(*key);
+
+    // decoding forward from the current position would not reach the target (or only through other GOPs)
+    if (last_decoded >= target || last_decoded < key_index - 1) {
+        if (seeked)
+            return false; // the seek did not get us there
+        decoder.seek_keyframe(*key);
+        last_decoded = key_index - 1;
+        seeked = true;
+        return true;
+    }
+
+    if (const int ret = decoder.decode_next_frame(); ret < 0) {
+        // the frame pool is exhausted by cached frames, make room and decode the GOP again
+        if (ret == AVERROR(ENOMEM) && decoder.get_frame_pool() && !lru.empty()) {
+            memory_budget = cached_bytes / 2;
+            evict(memory_budget);
+            last_decoded = std::numeric_limits<int64_t>::max();
+            seeked = false;
+            return true;
+        }
+        return false;
+    }
+
+    const AVFrame *frame = decoder.get_frame();
+    if (!frame || !frame->data[0])
+        return false;
+
+    const int64_t pts = frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : frame->pts;
+    if (pts == AV_NOPTS_VALUE)
+        throw std::runtime_error("Decoded frame has no timestamp");
+    const int64_t index = index_of(pts);
+    if (index < 0) {
+        last_decoded++;
+        return true;
+    }
+
+    // leading frames of an open GOP do not move the position back
+    last_decoded = std::max(last_decoded, index);
+    insert(index, frame);
+    return true;
+}
+
+void FrameCache::insert(const int64_t index, const AVFrame *frame) {
+    if (entries.contains(index))
+        return;
+
+    FramePtr ref(av_frame_clone(frame));
+    if (!ref)
+        return;
+
+    size_t bytes = 0;
+    for (int i = 0; i < AV_NUM_DATA_POINTERS && ref->buf[i]; i++)
+        bytes += ref->buf[i]->size;
+
+    // evict the least recently used frames to stay within the budget
+    evict(memory_budget > bytes ? memory_budget - bytes : 0);
+
+    lru.push_front(index);
+    entries.emplace(index, Entry{std::move(ref), bytes, lru.begin()});
+    cached_bytes += bytes;
+}
+
+void FrameCache::evict(const size_t max_bytes) {
+    while (!lru.empty() && cached_bytes > max_bytes) {
+        const auto victim = entries.find(lru.back());
+        cached_bytes -= victim->second.bytes;
+        entries.erase(victim);
+        lru.pop_back();
+    }
+}
+
+void FrameCache::touch(Entry &entry) {
+    lru.splice(lru.begin(), lru, entry.lru);
+}
+
+void FrameCache::prefetch() {
+    std::unique_lock lock(mutex);
+
+    while (!stopping) {
+        const uint64_t request_generation = generation;
+        auto new_request = [&] { return stopping || generation != request_generation; };
+
+        // nearest frame missing in the direction of playback
+        int64_t target = -1;
+        for (int i = 1; i <= prefetch_frames; i++) {
+            const int64_t index = current_index + direction * i;
+            if (index < 0 || index >= get_frame_count())
+                break;
+            if (!entries.contains(index)) {
+                target = index;
+                break;
+            }
+        }
+        if (target < 0) {
+            request.wait(lock, new_request);
+            continue;
+        }
+
+        bool seeked = false;
+        bool ok = true;
+        try {
+            while (ok && !entries.contains(target) && !new_request()) {
+                // requests go first, hand the lock over between frames
+                if (pending_requests > 0) {
+                    request.wait(lock, [this] { return stopping || pending_requests == 0; });
+                    continue;
+                }
+                ok = decode_step(target, seeked);
+            }
+        } catch (const std::exception &) {
+            ok = false;
+        }
+
+        // e.g. end of stream, retry on the next request
+        if (!ok)
+            request.wait(lock, new_request);
+    }
+}
@@ -0,0 +1,224 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#include "../include/FramePool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+extern "C" {
+    #include <libavutil/imgutils.h>
+    #include <libavutil/pixdesc.h>
+}
+
+namespace {
+    constexpr size_t huge_page_size = size_t{2} << 20;
+
+    size_t align_up(size_t value, size_t align) { return (value + align - 1) & ~(align - 1); }
+
+    // one per allocated block, only created when a bucket grows
+    struct Allocation {
+        std::shared_ptr<FramePool::Arena> arena;
+        size_t size = 0;
+        bool mapped = false;
+    };
+
+    void free_block(void *opaque, uint8_t *data) {
+        auto *allocation = static_cast<Allocation *>(opaque);
+#ifdef __linux__
+        if (allocation->mapped)
+            munmap(data, allocation->size);
+        else
+#endif
+            std::free(data);
+        allocation->arena->allocated -= allocation->size;
+        delete allocation;
+    }
+
+    AVBufferRef *alloc_block(void *opaque, size_t size) {
+        auto *arena = static_cast<FramePool::Arena *>(opaque);
+        auto *allocation = new Allocation{};
+
+        size_t reserved = arena->use_hugepages ? align_up(size, huge_page_size) : align_up(size, FramePool::alignment);
+        if (arena->allocated.fetch_add(reserved) + reserved > arena->memory_budget) {
+            arena->allocated -= reserved;
+            delete allocation;
+            return nullptr;
+        }
+
+        void *data = nullptr;
+#ifdef __linux__
+        if (arena->use_hugepages) {
+            data = mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (data == MAP_FAILED) {
+                // no reserved hugepages, ask for transparent ones instead
+                data = mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (data != MAP_FAILED)
+                    madvise(data, reserved, MADV_HUGEPAGE);
+            }
+            if (data == MAP_FAILED)
+                data = nullptr;
+            else
+                allocation->mapped = true;
+        }
+#endif
+        if (!allocation->mapped)
+            data = std::aligned_alloc(FramePool::alignment, reserved);
+
+        if (!data) {
+            arena->allocated -= reserved;
+            delete allocation;
+            return nullptr;
+        }
+
+        allocation->size = reserved;
+        // the buffers keep the arena alive, so accounting stays valid after the pool is gone
+        allocation->arena = arena->shared_from_this();
+
+        AVBufferRef *buf = av_buffer_create(static_cast<uint8_t *>(data), size, free_block, allocation, 0);
+        if (!buf) {
+            allocation->arena.reset();
+#ifdef __linux__
+            if (allocation->mapped)
+                munmap(data, reserved);
+            else
+#endif
+                std::free(data);
+            arena->allocated -= reserved;
+            delete allocation;
+        }
+        return buf;
+    }
+}
+
+FramePool::FramePool(const size_t memory_budget, const bool use_hugepages) : arena(std::make_shared<Arena>()) {
+    arena->memory_budget = memory_budget;
+    arena->use_hugepages = use_hugepages;
+}
+
+FramePool::~FramePool() {
+    // buffers still referenced by frames are freed once the last reference is dropped
+    for (auto &[_, bucket]: buckets)
+        av_buffer_pool_uninit(&bucket.pool);
+}
+
+size_t FramePool::get_allocated_bytes() const { return arena->allocated; }
+size_t FramePool::get_memory_budget() const { return arena->memory_budget; }
+
+FramePool::Bucket *FramePool::get_bucket(const AVPixelFormat pixel_format, const int width, const int height,
+                                         const int linesize_align) {
+    const Key key{pixel_format, width, height};
+    if (auto it = buckets.find(key); it != buckets.end())
+        return &it->second;
+
+    Bucket bucket;
+    const size_t align = std::max(alignment, linesize_align);
+    if (av_image_fill_linesizes(bucket.linesize, pixel_format, width) < 0)
+        return nullptr;
+
+    ptrdiff_t linesizes[4];
+    for (int i = 0; i < 4; i++) {
+        bucket.linesize[i] = static_cast<int>(align_up(bucket.linesize[i], align));
+        linesizes[i] = bucket.linesize[i];
+    }
+
+    size_t plane_sizes[4];
+    if (av_image_fill_plane_sizes(plane_sizes, pixel_format, height, linesizes) < 0)
+        return nullptr;
+
+    // all planes in one block, each starting on an aligned offset
+    for (int i = 0; i < 4 && plane_sizes[i]; i++) {
+        bucket.offset[i] = bucket.buffer_size;
+        bucket.buffer_size += align_up(plane_sizes[i], align);
+    }
+    // padding for SIMD code reading past the last plane
+    bucket.buffer_size += align;
+
+    bucket.pool = av_buffer_pool_init2(bucket.buffer_size, arena.get(), alloc_block, nullptr);
+    if (!bucket.pool)
+        return nullptr;
+
+    return &buckets.emplace(key, bucket).first->second;
+}
+
+bool FramePool::release_stale_buckets(const std::chrono::steady_clock::time_point now) {
+    const size_t allocated = arena->allocated;
+
+    for (auto it = buckets.begin(); it != buckets.end();) {
+        if (now - it->second.last_used < stale_after) {
+            ++it;
+            continue;
+        }
+        // frees the idle buffers now, the ones still referenced by frames when they are returned
+        av_buffer_pool_uninit(&it->second.pool);
+        it = buckets.erase(it);
+    }
+
+    // nothing gained if all their buffers are still in use
+    return arena->allocated < allocated;
+}
+
+int FramePool::get_buffer(AVFrame *frame, AVCodecContext *codec_context) {
+    const auto pixel_format = static_cast<AVPixelFormat>(frame->format);
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pixel_format);
+    if (!desc || desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM))
+        return AVERROR(ENOSYS);
+
+    int width = frame->width;
+    int height = frame->height;
+    int linesize_align[AV_NUM_DATA_POINTERS] = {};
+    if (codec_context && av_codec_is_decoder(codec_context->codec))
+        avcodec_align_dimensions2(codec_context, &width, &height, linesize_align);
+
+    std::lock_guard lock(mutex);
+    Bucket *bucket = get_bucket(pixel_format, width, height, linesize_align[0]);
+    if (!bucket)
+        return AVERROR(EINVAL);
+    const auto now = std::chrono::steady_clock::now();
+    bucket->last_used = now;
+
+    frame->buf[0] = av_buffer_pool_get(bucket->pool);
+    // over budget, make room by dropping the buckets of geometries no longer in use
+    if (!frame->buf[0] && release_stale_buckets(now))
+        frame->buf[0] = av_buffer_pool_get(bucket->pool);
+    if (!frame->buf[0])
+        return AVERROR(ENOMEM);
+
+    for (int i = 0; i < 4 && bucket->linesize[i]; i++) {
+        frame->data[i] = frame->buf[0]->data + bucket->offset[i];
+        frame->linesize[i] = bucket->linesize[i];
+    }
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+int FramePool::reserve(const AVPixelFormat pixel_format, const int width, const int height, const int count,
+                       AVCodecContext *codec_context) {
+    std::vector<AVFrame *> frames;
+    int ret = 0;
+
+    for (int i = 0; i < count; i++) {
+        AVFrame *reserved = av_frame_alloc();
+        if (!reserved) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        reserved->format = pixel_format;
+        reserved->width = width;
+        reserved->height = height;
+        frames.push_back(reserved);
+        if ((ret = get_buffer(reserved, codec_context)) < 0)
+            break;
+    }
+
+    // hand everything back to the bucket
+    for (AVFrame *reserved: frames)
+        av_frame_free(&reserved);
+    return ret;
+}
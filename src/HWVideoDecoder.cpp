@@ -3,6 +3,7 @@
 //
 
 #include "../include/HWVideoDecoder.h"
+#include "../include/Trace.h"
 
 #include <stdexcept>
 #include <vector>
@@ -12,6 +13,7 @@ extern "C" {
     #include <libavformat/avformat.h>
     #include <libavcodec/avcodec.h>
     #include <libavutil/imgutils.h>
+    #include <libavutil/hwcontext.h>
 }
 
 
@@ -27,7 +29,9 @@ AVPixelFormat HWVideoDecoder::get_hw_format(AVCodecContext *ctx, const AVPixelFo
     return AV_PIX_FMT_NONE;
 }
 
-HWVideoDecoder::HWVideoDecoder(const std::string &filename, const std::string &device_type) : VideoDecoderBase(filename) {
+HWVideoDecoder::HWVideoDecoder(const std::string &filename, const std::string &device_type,
+                               std::shared_ptr<FramePool> frame_pool, std::optional<LiveOptions> live)
+    : VideoDecoderBase(filename, std::move(frame_pool), std::move(live)) {
     int ret = 0;
 
     // av_log_set_level(AV_LOG_DEBUG);
@@ -36,22 +40,7 @@ HWVideoDecoder::HWVideoDecoder(const std::string &filename, const std::string &d
     if (type == AV_HWDEVICE_TYPE_NONE)
         throw std::runtime_error("Unknown device " + device_type);
 
-    AVFormatContext* raw_fmt_ctx = nullptr;
-    if ((ret = avformat_open_input(&raw_fmt_ctx, filename.c_str(), nullptr, nullptr)) < 0)
-        throw std::runtime_error("Could not open input file '" + filename + "': " + ffmpeg_error(ret));
-    format_context.reset(raw_fmt_ctx);
-
-    if ((ret = avformat_find_stream_info(format_context.get(), nullptr)) < 0)
-        throw std::runtime_error("Could not find stream info for '" + filename + "': " + ffmpeg_error(ret));
-
-    int video_stream_index = av_find_best_stream(format_context.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
-    if (video_stream_index < 0)
-        throw std::runtime_error("No suitable video stream found in file '" + filename + "'");
-
-    video_stream = format_context->streams[video_stream_index];
-    duration = (format_context->duration != AV_NOPTS_VALUE)
-                   ? static_cast<double>(format_context->duration) / AV_TIME_BASE
-                   : 0.0;
+    open_input();
 
     decoder = find_hw_decoder(type);
 
@@ -72,6 +61,8 @@ HWVideoDecoder::HWVideoDecoder(const std::string &filename, const std::string &d
     decoder_context->hw_device_ctx = av_buffer_ref(raw_av_buf); // TODO check failure?
     av_buffer_unref(&raw_av_buf);
 
+    apply_live_codec_options();
+
     if ((ret = avcodec_open2(decoder_context.get(), decoder, nullptr)) < 0)
         throw std::runtime_error("Failed to open codec: " + ffmpeg_error(ret));
 
@@ -125,27 +116,31 @@ std::expected<std::vector<uint8_t>, std::string> HWVideoDecoder::get_frame_vecto
     if (copy_frame_to_sw_frame() < 0)
         return std::unexpected("Error transferring the data to system memory");
 
-    if (!sw_frame || !sw_frame->data[0])
-        return std::unexpected("No frame available");
-
-    const auto pixel_format = static_cast<AVPixelFormat>(sw_frame->format);
-    int buf_size = av_image_get_buffer_size(pixel_format, sw_frame->width, sw_frame->height, 1);
-    if (buf_size < 0)
-        return std::unexpected("Failed to get buffer size for frame");
-
-    std::vector<uint8_t> buf(buf_size);
-    if (av_image_copy_to_buffer(buf.data(), buf_size,
-                                sw_frame->data, sw_frame->linesize,
-                                pixel_format, get_width(), get_height(), 1) < 0) {
-        return std::unexpected("Failed to copy frame to buffer");
-    }
-
+    // kernels are selected on the first transferred frame (the software format is known only then)
     // TODO convert to YUV420
-    return buf;
+    return copy_frame_to_vector(sw_frame.get());
 }
 
 int HWVideoDecoder::copy_frame_to_sw_frame() {
-    // TODO unref sw_frame??
-    // av_frame_unref(sw_frame.get());
-    return av_hwframe_transfer_data(sw_frame.get(), frame.get(), 0);
+    TraceSpan span("av_hwframe_transfer_data");
+
+    // never transfer into a buffer a previously returned frame may still reference
+    av_frame_unref(sw_frame.get());
+
+    if (frame_pool && frame->hw_frames_ctx) {
+        // transfer into a pooled buffer of the frames' software format
+        const auto *frames_ctx = reinterpret_cast<AVHWFramesContext *>(frame->hw_frames_ctx->data);
+        sw_frame->format = frames_ctx->sw_format;
+        sw_frame->width = frame->width;
+        sw_frame->height = frame->height;
+        if (frame_pool->get_buffer(sw_frame.get()) < 0)
+            av_frame_unref(sw_frame.get()); // let libav allocate instead
+    }
+
+    const int ret = av_hwframe_transfer_data(sw_frame.get(), frame.get(), 0);
+    if (ret < 0)
+        return ret;
+
+    // the transfer only copies the data, keep the timestamps
+    return av_frame_copy_props(sw_frame.get(), frame.get());
 }
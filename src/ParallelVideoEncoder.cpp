@@ -0,0 +1,328 @@
+//
+// Created by alex on 18.10.26.
+//
+#include "../include/ParallelVideoEncoder.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+extern "C" {
+    #include <libavutil/opt.h>
+}
+
+ParallelVideoEncoder::ParallelVideoEncoder(
+    const std::string &filename,
+    const int width, const int height,
+    const AVRational fps,
+    const AVPixelFormat pixelFormat,
+    const int chunk_size,
+    unsigned workers,
+    std::shared_ptr<FramePool> frame_pool,
+    size_t memory_budget):
+        pixelFormat(pixelFormat),
+        frame_pool(std::move(frame_pool)),
+        time_base{fps.den, fps.num}, // reciprocal of fps
+        width(width),
+        height(height) {
+    if (time_base.num <= 0 || time_base.den <= 0) {
+        throw std::runtime_error("invalid frame rate");
+    }
+
+    // select the copy kernels for the pixel format once
+    frame_kernels = get_frame_kernels(pixelFormat, width, height);
+    if (!frame_kernels.is_valid()) {
+        throw std::runtime_error("unsupported pixel format");
+    }
+
+    // raw frames held by the chunks, the pool fails allocations beyond its budget instead of waiting
+    if (this->frame_pool)
+        memory_budget = std::min(memory_budget, this->frame_pool->get_memory_budget());
+    const size_t frame_bytes = av_image_get_buffer_size(pixelFormat, width, height, FramePool::alignment) +
+                               4 * FramePool::alignment; // plane alignment and padding of pooled buffers
+    const size_t budget_frames = memory_budget / frame_bytes;
+    // the chunk being filled and at least one being encoded
+    if (budget_frames < static_cast<size_t>(2 * gop_size)) {
+        throw std::runtime_error("memory budget too small for two GOPs");
+    }
+
+    // chunks always end on a GOP boundary
+    this->chunk_size = std::max(gop_size, (chunk_size + gop_size - 1) / gop_size * gop_size);
+    this->chunk_size = std::min(this->chunk_size, static_cast<int>(budget_frames / 2) / gop_size * gop_size);
+
+    if (workers == 0)
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    // every worker busy plus one chunk queued, each of them holds chunk_size raw frames
+    max_encoding_chunks = std::min<size_t>(workers + 1, budget_frames / this->chunk_size - 1);
+    workers = std::min<unsigned>(workers, max_encoding_chunks);
+    max_encoded_chunks = 4 * static_cast<size_t>(workers);
+    // spread the cores over the chunks instead of letting every encoder spawn its own threads
+    encoder_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency() / workers));
+
+    // guess output format based on filename
+    if (avformat_alloc_output_context2(&output_context, nullptr, nullptr, filename.c_str()) < 0) {
+        throw std::runtime_error("failed to allocate output context");
+    }
+    if (!output_context) {
+        throw std::runtime_error("failed to create output context (unable to guess output format)");
+    }
+
+    video_codec = avcodec_find_encoder(output_context->oformat->video_codec);
+    if (!video_codec) {
+        throw std::runtime_error("failed to find encoder");
+    }
+
+    stream = avformat_new_stream(output_context, nullptr);
+    if (!stream) {
+        throw std::runtime_error("failed to allocate output stream");
+    }
+    stream->id = output_context->nb_streams - 1;
+    stream->time_base = time_base;
+
+    // the chunk encoders share all settings, so a reference context provides the stream parameters (extradata)
+    {
+        const auto reference_context = open_encoder_context(encoder_threads);
+        if (avcodec_parameters_from_context(stream->codecpar, reference_context.get()) < 0) {
+            throw std::runtime_error("failed to copy encoder context");
+        }
+    }
+
+    // print info on the video stream
+    av_dump_format(output_context, 0, filename.c_str(), 1);
+
+    // open output file
+    if (avio_open(&output_context->pb, filename.c_str(), AVIO_FLAG_WRITE) < 0) {
+        throw std::runtime_error("failed to open output");
+    }
+
+    // write header to file
+    if (avformat_write_header(output_context, nullptr) < 0) {
+        throw std::runtime_error("failed to write header");
+    }
+
+    current_chunk = std::make_unique<Chunk>();
+    for (unsigned i = 0; i < workers; i++)
+        worker_threads.emplace_back(&ParallelVideoEncoder::worker, this);
+}
+
+std::unique_ptr<AVCodecContext, ParallelVideoEncoder::CtxDeleter>
+ParallelVideoEncoder::open_encoder_context(const int thread_count) const {
+    std::unique_ptr<AVCodecContext, CtxDeleter> encoder_context(avcodec_alloc_context3(video_codec));
+    if (!encoder_context) {
+        throw std::runtime_error("failed to allocate encoder context");
+    }
+
+    encoder_context->codec_id = video_codec->id;
+    encoder_context->bit_rate = 400000;
+    encoder_context->width = width;
+    encoder_context->height = height;
+    encoder_context->time_base = time_base;
+    encoder_context->framerate = av_inv_q(time_base);
+    encoder_context->gop_size = gop_size;
+    encoder_context->pix_fmt = pixelFormat;
+    encoder_context->thread_count = thread_count;
+    encoder_context->flags |= AV_CODEC_FLAG_CLOSED_GOP;
+
+    if (output_context->oformat->flags & AVFMT_GLOBALHEADER)
+        encoder_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    // keyframes at chunk starts have to be IDR frames (libx264, ignored by other encoders)
+    av_opt_set(encoder_context->priv_data, "forced-idr", "1", AV_OPT_SEARCH_CHILDREN);
+
+    if (avcodec_open2(encoder_context.get(), video_codec, nullptr) < 0) {
+        throw std::runtime_error("failed to open encoder");
+    }
+    return encoder_context;
+}
+
+void ParallelVideoEncoder::encode_frame(const std::vector<uint8_t> &image_buf) {
+    // ensure image_buf size
+    if (image_buf.size() != frame_kernels.buffer_size) {
+        throw std::runtime_error("image buffer has wrong size!");
+    }
+
+    // the chunk keeps its frames until it is encoded, so the image has to be copied
+    std::unique_ptr<AVFrame, FrameDeleter> frame(av_frame_alloc());
+    if (!frame) {
+        throw std::runtime_error("failed to allocate frame");
+    }
+    frame->format = pixelFormat;
+    frame->width  = width;
+    frame->height = height;
+    if ((frame_pool ? frame_pool->get_buffer(frame.get()) : av_frame_get_buffer(frame.get(), 0)) < 0) {
+        throw std::runtime_error("failed to allocate frame data buffers");
+    }
+
+    frame_kernels.from_buffer(frame_kernels, image_buf.data(), frame.get());
+
+    frame->pts = next_pts++;
+    current_chunk->frames.push_back(std::move(frame));
+
+    if (current_chunk->frames.size() >= static_cast<size_t>(chunk_size))
+        submit_chunk();
+}
+
+void ParallelVideoEncoder::submit_chunk() {
+    if (current_chunk->frames.empty())
+        return;
+
+    // keep the amount of buffered raw frames (and of encoded packets waiting for an earlier chunk) bounded
+    auto has_room = [this] {
+        return encoding_chunks < max_encoding_chunks && in_flight.size() - encoding_chunks < max_encoded_chunks;
+    };
+    while (true) {
+        write_chunks(false);
+
+        std::unique_lock lock(mutex);
+        chunk_done.wait(lock, [&] { return has_room() || in_flight.front()->done; });
+        if (has_room())
+            break;
+    }
+
+    std::shared_ptr<Chunk> chunk = std::move(current_chunk);
+    current_chunk = std::make_unique<Chunk>();
+    {
+        std::lock_guard lock(mutex);
+        in_flight.push_back(chunk);
+        pending.push_back(chunk);
+        encoding_chunks++;
+    }
+    work_available.notify_one();
+}
+
+void ParallelVideoEncoder::write_chunks(const bool wait_all) {
+    while (true) {
+        std::shared_ptr<Chunk> chunk;
+        {
+            std::unique_lock lock(mutex);
+            if (in_flight.empty())
+                return;
+            if (wait_all)
+                chunk_done.wait(lock, [this] { return in_flight.front()->done; });
+            if (!in_flight.front()->done)
+                return;
+            chunk = std::move(in_flight.front());
+            in_flight.pop_front();
+        }
+        chunk_done.notify_all();
+
+        if (!chunk->error.empty()) {
+            throw std::runtime_error(chunk->error);
+        }
+
+        // chunks are written in order, the packets already carry the global timestamps
+        for (auto &packet: chunk->packets) {
+            av_packet_rescale_ts(packet.get(), time_base, stream->time_base);
+            packet->stream_index = stream->index;
+
+            if (av_interleaved_write_frame(output_context, packet.get()) < 0) {
+                throw std::runtime_error("failed to write frame");
+            }
+        }
+    }
+}
+
+void ParallelVideoEncoder::encode_chunk(Chunk &chunk) const {
+    const auto encoder_context = open_encoder_context(encoder_threads);
+
+    auto receive_packets = [&] {
+        // frame may end up as multiple packets
+        while (true) {
+            std::unique_ptr<AVPacket, PktDeleter> packet(av_packet_alloc());
+            if (!packet) {
+                throw std::runtime_error("failed to allocate packet");
+            }
+            const int ret = avcodec_receive_packet(encoder_context.get(), packet.get());
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                break;
+            } else if (ret < 0) {
+                throw std::runtime_error(std::string("failed to receive packet") + av_err2str(ret));
+            }
+            chunk.packets.push_back(std::move(packet));
+        }
+    };
+
+    for (auto &frame: chunk.frames) {
+        if (avcodec_send_frame(encoder_context.get(), frame.get())) {
+            throw std::runtime_error("failed to send frame");
+        }
+        receive_packets();
+        frame.reset(); // hand the buffer back as soon as possible
+    }
+
+    // flush encoder
+    const int ret = avcodec_send_frame(encoder_context.get(), nullptr);
+    if (ret < 0 && ret != AVERROR_EOF) {
+        throw std::runtime_error("flushing encoder failed");
+    }
+    receive_packets();
+}
+
+void ParallelVideoEncoder::worker() {
+    while (true) {
+        std::shared_ptr<Chunk> chunk;
+        {
+            std::unique_lock lock(mutex);
+            work_available.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (pending.empty())
+                return;
+            chunk = std::move(pending.front());
+            pending.pop_front();
+        }
+
+        try {
+            encode_chunk(*chunk);
+        } catch (const std::exception &e) {
+            chunk->error = e.what();
+        }
+        chunk->frames.clear();
+
+        {
+            std::lock_guard lock(mutex);
+            chunk->done = true;
+            encoding_chunks--;
+        }
+        chunk_done.notify_all();
+    }
+}
+
+void ParallelVideoEncoder::finish() {
+    if (finished)
+        return;
+    finished = true;
+
+    submit_chunk();
+    write_chunks(true);
+
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (auto &thread: worker_threads)
+        thread.join();
+    worker_threads.clear();
+
+    // write the end of the file
+    av_write_trailer(output_context);
+}
+
+ParallelVideoEncoder::~ParallelVideoEncoder() {
+    try {
+        finish();
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Error finishing parallel encode: %s\n", e.what());
+    }
+
+    // stop the workers if finishing failed half way
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+        pending.clear();
+    }
+    work_available.notify_all();
+    for (auto &thread: worker_threads)
+        thread.join();
+
+    avio_closep(&output_context->pb);
+    avformat_free_context(output_context);
+}
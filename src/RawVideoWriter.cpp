@@ -0,0 +1,200 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#include "../include/RawVideoWriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+    size_t align_up(size_t value, size_t align) { return (value + align - 1) & ~(align - 1); }
+
+    std::string system_error(const std::string &message, const int errnum = errno) {
+        return message + ": " + std::strerror(errnum);
+    }
+
+    const char *y4m_colorspace(const AVPixelFormat pixel_format) {
+        switch (pixel_format) {
+            case AV_PIX_FMT_YUV420P: return "420jpeg";
+            case AV_PIX_FMT_YUV422P: return "422";
+            case AV_PIX_FMT_YUV444P: return "444";
+            case AV_PIX_FMT_GRAY8:   return "mono";
+            default:                 return nullptr;
+        }
+    }
+}
+
+RawVideoWriter::RawVideoWriter(
+    const std::string &filename,
+    const int width, const int height,
+    const AVRational fps,
+    const AVPixelFormat pixelFormat,
+    const Container container,
+    const Output output):
+        container(container),
+        output(output) {
+    // select the copy kernels for the pixel format once
+    frame_kernels = get_frame_kernels(pixelFormat, width, height);
+    if (!frame_kernels.is_valid()) {
+        throw std::runtime_error("unsupported pixel format");
+    }
+
+    std::string header;
+    if (container == Container::Y4M) {
+        const char *colorspace = y4m_colorspace(pixelFormat);
+        if (!colorspace) {
+            throw std::runtime_error("pixel format not supported by Y4M");
+        }
+        header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) +
+                 " F" + std::to_string(fps.num) + ":" + std::to_string(fps.den) +
+                 " Ip A1:1 C" + colorspace + "\n";
+    }
+
+    fd.reset(::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644));
+    if (fd.get() < 0) {
+        throw std::runtime_error(system_error("failed to open output '" + filename + "'"));
+    }
+
+    if (output == Output::WRITE) {
+        batch_capacity = align_up(std::max(write_batch, header.size() + sizeof(frame_header) + frame_kernels.buffer_size), page_size);
+        batch.reset(static_cast<uint8_t *>(std::aligned_alloc(page_size, batch_capacity)));
+        if (!batch) {
+            throw std::runtime_error("failed to allocate write buffer");
+        }
+    }
+
+    if (!header.empty())
+        std::memcpy(reserve(header.size()), header.data(), header.size());
+}
+
+RawVideoWriter::~RawVideoWriter() {
+    try {
+        close();
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Error closing raw video output: %s\n", e.what());
+    }
+}
+
+void RawVideoWriter::FileDescriptor::reset(const int fd) {
+    if (this->fd >= 0)
+        ::close(this->fd);
+    this->fd = fd;
+}
+
+int64_t RawVideoWriter::get_frame_count() const { return frame_count; }
+
+void RawVideoWriter::remap(const size_t bytes) {
+    if (map && munmap(map, map_size) < 0) {
+        throw std::runtime_error(system_error("failed to unmap output"));
+    }
+    map = nullptr;
+
+    // windows start on the page containing the current position, so a frame never spans two windows
+    map_offset = position & ~(page_size - 1);
+    map_size = std::max(mmap_window, align_up(position + bytes - map_offset, page_size));
+
+    // preallocate the blocks of the window (trimmed to the written size on close)
+    const off_t file_size = static_cast<off_t>(map_offset + map_size);
+    // posix_fallocate returns the error instead of setting errno
+    if (const int ret = posix_fallocate(fd.get(), 0, file_size); ret != 0) {
+        if (ret != EOPNOTSUPP) {
+            throw std::runtime_error(system_error("failed to preallocate output", ret));
+        }
+        // no preallocation on this filesystem, extend it sparsely
+        if (ftruncate(fd.get(), file_size) < 0) {
+            throw std::runtime_error(system_error("failed to extend output"));
+        }
+    }
+
+    void *window = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), static_cast<off_t>(map_offset));
+    if (window == MAP_FAILED) {
+        throw std::runtime_error(system_error("failed to map output"));
+    }
+    map = static_cast<uint8_t *>(window);
+    madvise(map, map_size, MADV_SEQUENTIAL);
+}
+
+void RawVideoWriter::flush_batch() {
+    size_t written = 0;
+    while (written < batch_size) {
+        const ssize_t ret = ::write(fd.get(), batch.get() + written, batch_size - written);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(system_error("failed to write output"));
+        }
+        written += ret;
+    }
+    batch_size = 0;
+}
+
+uint8_t *RawVideoWriter::reserve(const size_t bytes) {
+    uint8_t *ptr;
+    if (output == Output::MMAP) {
+        if (!map || position + bytes > map_offset + map_size)
+            remap(bytes);
+        ptr = map + (position - map_offset);
+    } else {
+        if (batch_size + bytes > batch_capacity)
+            flush_batch();
+        ptr = batch.get() + batch_size;
+        batch_size += bytes;
+    }
+    position += bytes;
+    return ptr;
+}
+
+uint8_t *RawVideoWriter::begin_frame() {
+    if (fd.get() < 0) {
+        throw std::runtime_error("output already closed");
+    }
+
+    const size_t header_size = container == Container::Y4M ? sizeof(frame_header) - 1 : 0;
+    uint8_t *ptr = reserve(header_size + frame_kernels.buffer_size);
+    std::memcpy(ptr, frame_header, header_size);
+    frame_count++;
+    return ptr + header_size;
+}
+
+void RawVideoWriter::write_frame(const AVFrame *frame) {
+    if (!frame_kernels.matches(frame)) {
+        throw std::runtime_error("frame does not match the output format");
+    }
+    frame_kernels.to_buffer(frame_kernels, frame, begin_frame());
+}
+
+void RawVideoWriter::write_frame(const std::vector<uint8_t> &image_buf) {
+    if (image_buf.size() != frame_kernels.buffer_size) {
+        throw std::runtime_error("image buffer has wrong size!");
+    }
+    std::memcpy(begin_frame(), image_buf.data(), image_buf.size());
+}
+
+void RawVideoWriter::close() {
+    if (fd.get() < 0)
+        return;
+
+    if (output == Output::MMAP) {
+        if (map && munmap(map, map_size) < 0) {
+            throw std::runtime_error(system_error("failed to unmap output"));
+        }
+        map = nullptr;
+        // drop the preallocated but unused tail
+        if (ftruncate(fd.get(), static_cast<off_t>(position)) < 0) {
+            throw std::runtime_error(system_error("failed to trim output"));
+        }
+    } else {
+        flush_batch();
+    }
+
+    fd.reset();
+}
@@ -0,0 +1,177 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#include "../include/Trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Trace::enabled{false};
+
+namespace {
+    constexpr size_t events_per_thread = size_t{1} << 16;
+
+    // slots carry a sequence number, so a reader can detect a slot being overwritten while it is read
+    struct Event {
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<int> tid{0};
+        std::atomic<const char *> name{nullptr};
+        std::atomic<int64_t> start{0};
+        std::atomic<int64_t> end{0};
+    };
+
+    // single producer (the thread currently owning it), read by the exporter
+    struct ThreadBuffer {
+        std::atomic<uint64_t> head{0};
+        std::unique_ptr<Event[]> events = std::make_unique<Event[]>(events_per_thread);
+    };
+
+    std::mutex registry_mutex;
+    // buffers are never freed, the ones of finished threads are handed to new threads (their spans carry the
+    // thread id, so they stay exportable until overwritten)
+    std::vector<std::unique_ptr<ThreadBuffer>> registry;
+    std::vector<ThreadBuffer *> free_buffers;
+    std::map<int, std::string> thread_names;
+    int next_tid = 0;
+    std::atomic<int64_t> epoch{0};
+
+    // nothing is allocated before the thread records its first span
+    struct ThreadState {
+        int tid = 0;
+        std::string name;
+        ThreadBuffer *buffer = nullptr;
+
+        ThreadBuffer &acquire() {
+            if (!buffer) {
+                std::lock_guard lock(registry_mutex);
+                tid = ++next_tid;
+                if (!name.empty())
+                    thread_names[tid] = name;
+                if (!free_buffers.empty()) {
+                    buffer = free_buffers.back();
+                    free_buffers.pop_back();
+                } else {
+                    buffer = registry.emplace_back(std::make_unique<ThreadBuffer>()).get();
+                }
+            }
+            return *buffer;
+        }
+
+        ~ThreadState() {
+            if (buffer) {
+                std::lock_guard lock(registry_mutex);
+                free_buffers.push_back(buffer);
+            }
+        }
+    };
+
+    thread_local ThreadState thread_state;
+
+    std::string escape(const std::string &s) {
+        std::string escaped;
+        for (const char c: s) {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+}
+
+void Trace::enable() {
+    epoch = now();
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+void Trace::disable() {
+    enabled.store(false, std::memory_order_relaxed);
+}
+
+void Trace::set_thread_name(const std::string &name) {
+    thread_state.name = name;
+    if (thread_state.buffer) {
+        std::lock_guard lock(registry_mutex);
+        if (name.empty())
+            thread_names.erase(thread_state.tid);
+        else
+            thread_names[thread_state.tid] = name;
+    }
+}
+
+std::string Trace::get_thread_name() { return thread_state.name; }
+
+void Trace::record(const char *name, const int64_t start, const int64_t end) {
+    ThreadBuffer &buffer = thread_state.acquire();
+    const uint64_t index = buffer.head.load(std::memory_order_relaxed);
+    Event &event = buffer.events[index % events_per_thread];
+
+    // odd while writing
+    event.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.tid.store(thread_state.tid, std::memory_order_relaxed);
+    event.name.store(name, std::memory_order_relaxed);
+    event.start.store(start, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+    event.sequence.store(2 * index + 2, std::memory_order_release);
+
+    buffer.head.store(index + 1, std::memory_order_release);
+}
+
+std::string Trace::to_json() {
+    const int64_t start_time = epoch.load();
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto append = [&](const std::string &event) {
+        if (!first)
+            json += ',';
+        json += event;
+        first = false;
+    };
+
+    std::lock_guard lock(registry_mutex);
+    for (const auto &[tid, name]: thread_names)
+        append(R"({"name":"thread_name","ph":"M","pid":1,"tid":)" + std::to_string(tid) +
+               R"(,"args":{"name":")" + escape(name) + R"("}})");
+
+    for (const auto &buffer: registry) {
+        const uint64_t head = buffer->head.load(std::memory_order_acquire);
+        const uint64_t count = std::min<uint64_t>(head, events_per_thread);
+        for (uint64_t index = head - count; index < head; index++) {
+            const Event &event = buffer->events[index % events_per_thread];
+
+            const uint64_t sequence = event.sequence.load(std::memory_order_acquire);
+            const int tid = event.tid.load(std::memory_order_relaxed);
+            const char *name = event.name.load(std::memory_order_relaxed);
+            const int64_t start = event.start.load(std::memory_order_relaxed);
+            const int64_t end = event.end.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            // skip slots the owner thread overwrote in the meantime and spans from before enable()
+            if (sequence != 2 * index + 2 || event.sequence.load(std::memory_order_relaxed) != sequence)
+                continue;
+            if (!name || start < start_time)
+                continue;
+
+            char times[64];
+            snprintf(times, sizeof(times), R"("ts":%.3f,"dur":%.3f)",
+                     static_cast<double>(start - start_time) * 1e-3, static_cast<double>(end - start) * 1e-3);
+            append(R"({"name":")" + escape(name) + R"(","ph":"X","pid":1,"tid":)" + std::to_string(tid) +
+                   "," + times + "}");
+        }
+    }
+
+    json += "]}";
+    return json;
+}
+
+bool Trace::write_json(const std::string &filename) {
+    std::ofstream file(filename, std::ios::binary);
+    file << to_json();
+    return static_cast<bool>(file);
+}
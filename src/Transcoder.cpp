@@ -0,0 +1,229 @@
+//
+// Created by alex on 18.10.26.
+//
+
+#include "../include/Transcoder.h"
+
+#include <stdexcept>
+#include <thread>
+
+#include "../include/Frame.h"
+#include "../include/Trace.h"
+
+namespace {
+    // accumulates the time spent in a scope into a stage
+    class BusyTimer {
+    public:
+        explicit BusyTimer(std::atomic<int64_t> &busy_ns) : busy_ns(busy_ns), start(std::chrono::steady_clock::now()) {}
+        ~BusyTimer() {
+            busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+    private:
+        std::atomic<int64_t> &busy_ns;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // names the calling thread in traces for the lifetime of the object
+    class ThreadName {
+    public:
+        explicit ThreadName(const std::string &name) : previous(Trace::get_thread_name()) { Trace::set_thread_name(name); }
+        ~ThreadName() { Trace::set_thread_name(previous); }
+    private:
+        std::string previous;
+    };
+}
+
+Transcoder::Transcoder(VideoDecoderBase &decoder, VideoEncoder &encoder,
+                       const size_t queue_size, std::shared_ptr<FramePool> frame_pool)
+    : decoder(decoder), encoder(encoder), frame_pool(std::move(frame_pool)), queue_size(queue_size) {}
+
+Transcoder::~Transcoder() {
+    sws_freeContext(sws_context);
+}
+
+void Transcoder::set_error() {
+    std::lock_guard lock(error_mutex);
+    if (!error)
+        error = std::current_exception();
+    failed = true;
+}
+
+int64_t Transcoder::run(const int64_t max_frames) {
+    for (Stage *stage: {&decode_stage, &convert_stage, &encode_stage}) {
+        stage->frames = 0;
+        stage->busy_ns = 0;
+    }
+    error = nullptr;
+    failed = false;
+    last_pts = AV_NOPTS_VALUE;
+    dropped_frames = 0;
+
+    BoundedQueue<FramePtr> decoded(queue_size);
+    BoundedQueue<FramePtr> converted(queue_size);
+    int64_t encoded = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    {
+        std::jthread decode_thread([&] { decode(decoded, max_frames); });
+        std::jthread convert_thread([&] { convert(decoded, converted); });
+        encoded = encode(converted);
+
+        // unblock the other stages if encoding stopped early
+        decoded.close();
+        converted.close();
+    }
+    run_time = std::chrono::steady_clock::now() - start;
+
+    if (error)
+        std::rethrow_exception(error);
+    return encoded;
+}
+
+void Transcoder::decode(BoundedQueue<FramePtr> &output, const int64_t max_frames) {
+    Trace::set_thread_name("decode");
+    try {
+        for (int64_t i = 0; !failed && (max_frames < 0 || i < max_frames); i++) {
+            FramePtr frame;
+            {
+                BusyTimer timer(decode_stage.busy_ns);
+                if (decoder.decode_next_frame() < 0)
+                    break;
+
+                // new reference, the decoder reuses its frame for the next one
+                const AVFrame *decoded_frame = decoder.get_frame();
+                if (!decoded_frame || !decoded_frame->data[0])
+                    throw std::runtime_error("Error transferring the data to system memory");
+                frame.reset(av_frame_clone(decoded_frame));
+                if (!frame)
+                    throw std::runtime_error("Failed to reference AVFrame");
+            }
+            decode_stage.frames++;
+            if (!output.push(std::move(frame)))
+                break;
+        }
+    } catch (...) {
+        set_error();
+    }
+    output.close();
+}
+
+void Transcoder::convert(BoundedQueue<FramePtr> &input, BoundedQueue<FramePtr> &output) {
+    Trace::set_thread_name("convert");
+    try {
+        while (auto frame = input.pop()) {
+            if (failed)
+                break;
+            FramePtr converted;
+            {
+                BusyTimer timer(convert_stage.busy_ns);
+                converted = convert_frame(std::move(*frame));
+            }
+            convert_stage.frames++;
+            if (!output.push(std::move(converted)))
+                break;
+        }
+    } catch (...) {
+        set_error();
+    }
+    input.close();
+    output.close();
+}
+
+Transcoder::FramePtr Transcoder::convert_frame(FramePtr src) {
+    const AVPixelFormat dst_format = encoder.get_pixel_format();
+    const int dst_width = encoder.get_width();
+    const int dst_height = encoder.get_height();
+
+    // nothing to do, pass the reference on
+    if (src->format == dst_format && src->width == dst_width && src->height == dst_height)
+        return src;
+
+    FramePtr dst(av_frame_alloc());
+    if (!dst)
+        throw std::runtime_error("Failed to allocate AVFrame");
+    dst->format = dst_format;
+    dst->width = dst_width;
+    dst->height = dst_height;
+    if ((frame_pool ? frame_pool->get_buffer(dst.get()) : av_frame_get_buffer(dst.get(), 0)) < 0)
+        throw std::runtime_error("Failed to allocate frame data buffers");
+    av_frame_copy_props(dst.get(), src.get());
+
+    // hardware decoders typically output NV12
+    if (src->format == AV_PIX_FMT_NV12 && dst_format == AV_PIX_FMT_YUV420P &&
+        src->width == dst_width && src->height == dst_height) {
+        TraceSpan span("convert nv12");
+        ::convert(Frame<NV12>(src.get()), Frame<YUV420P>(dst.get()));
+        return dst;
+    }
+
+    sws_context = sws_getCachedContext(sws_context,
+                                       src->width, src->height, static_cast<AVPixelFormat>(src->format),
+                                       dst_width, dst_height, dst_format,
+                                       SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!sws_context)
+        throw std::runtime_error("Failed to create conversion context");
+
+    TraceSpan span("sws_scale");
+    sws_scale(sws_context, src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+    return dst;
+}
+
+int64_t Transcoder::encode(BoundedQueue<FramePtr> &input) {
+    const AVRational decoder_time_base = decoder.get_time_base();
+    const AVRational encoder_time_base = encoder.get_time_base();
+    int64_t encoded = 0;
+
+    // runs on the calling thread, which gets its name back afterward
+    ThreadName thread_name("encode");
+    try {
+        while (auto frame = input.pop()) {
+            if (failed)
+                break;
+            {
+                BusyTimer timer(encode_stage.busy_ns);
+                AVFrame *av_frame = frame->get();
+
+                // decoder -> encoder time base, the encoder needs strictly increasing timestamps
+                int64_t pts = av_frame->best_effort_timestamp != AV_NOPTS_VALUE ? av_frame->best_effort_timestamp : av_frame->pts;
+                if (pts == AV_NOPTS_VALUE) {
+                    // no timestamps at all, number the frames
+                    pts = last_pts != AV_NOPTS_VALUE ? last_pts + 1 : 0;
+                } else {
+                    pts = av_rescale_q(pts, decoder_time_base, encoder_time_base);
+                    // faster than the encoder frame rate, drop instead of renumbering (that changes the speed)
+                    if (last_pts != AV_NOPTS_VALUE && pts <= last_pts) {
+                        dropped_frames++;
+                        continue;
+                    }
+                }
+                av_frame->pts = last_pts = pts;
+                av_frame->pict_type = AV_PICTURE_TYPE_NONE;
+
+                encoder.encode_frame(av_frame);
+            }
+            encode_stage.frames++;
+            encoded++;
+        }
+    } catch (...) {
+        set_error();
+    }
+    input.close();
+    return encoded;
+}
+
+std::vector<Transcoder::StageStats> Transcoder::get_stage_stats() const {
+    const double wall_time = std::chrono::duration<double>(run_time).count();
+
+    std::vector<StageStats> stats;
+    for (const Stage *stage: {&decode_stage, &convert_stage, &encode_stage}) {
+        StageStats stage_stats;
+        stage_stats.name = stage->name;
+        stage_stats.frames = stage->frames;
+        stage_stats.busy_time = static_cast<double>(stage->busy_ns) * 1e-9;
+        stage_stats.utilization = wall_time > 0.0 ? stage_stats.busy_time / wall_time : 0.0;
+        stats.push_back(stage_stats);
+    }
+    return stats;
+}
+
+int64_t Transcoder::get_dropped_frames() const { return dropped_frames; }
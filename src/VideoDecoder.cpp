@@ -16,25 +16,12 @@ extern "C" {
 }
 
 
-VideoDecoder::VideoDecoder(const std::string &filename) : VideoDecoderBase(filename) {
+VideoDecoder::VideoDecoder(const std::string &filename, std::shared_ptr<FramePool> frame_pool,
+                           std::optional<LiveOptions> live)
+    : VideoDecoderBase(filename, std::move(frame_pool), std::move(live)) {
     int ret = 0;
 
-    AVFormatContext* raw_fmt_ctx = nullptr;
-    if ((ret = avformat_open_input(&raw_fmt_ctx, filename.c_str(), nullptr, nullptr)) < 0)
-        throw std::runtime_error("Could not open input file '" + filename + "': " + ffmpeg_error(ret));
-    format_context.reset(raw_fmt_ctx);
-
-    if ((ret = avformat_find_stream_info(format_context.get(), nullptr)) < 0)
-        throw std::runtime_error("Could not find stream info for '" + filename + "': " + ffmpeg_error(ret));
-
-    int video_stream_index = av_find_best_stream(format_context.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
-    if (video_stream_index < 0)
-        throw std::runtime_error("No suitable video stream found in file '" + filename + "'");
-
-    video_stream = format_context->streams[video_stream_index];
-    duration = (format_context->duration != AV_NOPTS_VALUE)
-                   ? static_cast<double>(format_context->duration) / AV_TIME_BASE
-                   : 0.0;
+    open_input();
 
     decoder = avcodec_find_decoder(video_stream->codecpar->codec_id);
     if (!decoder)
@@ -47,9 +34,20 @@ VideoDecoder::VideoDecoder(const std::string &filename) : VideoDecoderBase(filen
     if ((ret = avcodec_parameters_to_context(decoder_context.get(), video_stream->codecpar)) < 0)
         throw std::runtime_error("Failed to copy codec parameters: " + ffmpeg_error(ret));
 
+    // decode into pooled buffers (only for decoders supporting custom allocation)
+    if (this->frame_pool && decoder->capabilities & AV_CODEC_CAP_DR1) {
+        decoder_context->opaque = static_cast<VideoDecoderBase *>(this);
+        decoder_context->get_buffer2 = get_pooled_buffer;
+    }
+
+    apply_live_codec_options();
+
     if ((ret = avcodec_open2(decoder_context.get(), decoder, nullptr)) < 0)
         throw std::runtime_error("Failed to open codec: " + ffmpeg_error(ret));
 
+    // select the copy kernels for the stream once
+    frame_kernels = get_frame_kernels(decoder_context->pix_fmt, decoder_context->width, decoder_context->height);
+
     packet.reset(av_packet_alloc());
     if (!packet) throw std::runtime_error("Failed to allocate AVPacket");
 
@@ -68,20 +66,5 @@ VideoDecoder::VideoDecoder(const std::string &filename) : VideoDecoderBase(filen
 AVFrame* VideoDecoder::get_frame() { return frame.get(); }
 
 std::expected<std::vector<uint8_t>, std::string> VideoDecoder::get_frame_vector() {
-    if (!frame || !frame->data[0])
-        return std::unexpected("No frame available");
-
-    const auto pixel_format = static_cast<AVPixelFormat>(frame->format);
-    int buf_size = av_image_get_buffer_size(pixel_format, get_width(), get_height(), 1);
-    if (buf_size < 0)
-        return std::unexpected("Failed to get buffer size for frame");
-
-    std::vector<uint8_t> buf(buf_size);
-    if (av_image_copy_to_buffer(buf.data(), buf_size,
-                                frame->data, frame->linesize,
-                                pixel_format, get_width(), get_height(), 1) < 0) {
-        return std::unexpected("Failed to copy frame to buffer");
-    }
-
-    return buf;
+    return copy_frame_to_vector(frame.get());
 }
\ No newline at end of file
@@ -3,9 +3,44 @@
 //
 
 #include "VideoDecoderBase.h"
+#include "Trace.h"
 
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
 #include <utility>
 
+namespace {
+    /// first slice of the packet is not referenced by other frames (Annex B H.264/HEVC only)
+    bool is_non_reference(const AVPacket *pkt, const AVCodecParameters *par) {
+        if (par->codec_id != AV_CODEC_ID_H264 && par->codec_id != AV_CODEC_ID_HEVC)
+            return false;
+        // avcC/hvcC extradata: length prefixed NAL units, lengths could pass for start codes
+        if (par->extradata_size > 0 && par->extradata[0] == 1)
+            return false;
+
+        const uint8_t *p = pkt->data;
+        const uint8_t *end = pkt->data + pkt->size;
+        while (end - p >= 4) {
+            if (p[0] != 0 || p[1] != 0 || p[2] != 1) {
+                p++;
+                continue;
+            }
+            p += 3;
+            if (par->codec_id == AV_CODEC_ID_H264) {
+                const int type = p[0] & 0x1f;
+                if (type == 1 || type == 5)
+                    return (p[0] & 0x60) == 0;  // nal_ref_idc
+            } else {
+                const int type = (p[0] >> 1) & 0x3f;
+                if (type < 32)
+                    return type <= 14 && type % 2 == 0;  // TRAIL_N, TSA_N, STSA_N, RADL_N, RASL_N, reserved
+            }
+        }
+        return false;
+    }
+}
+
 std::string ffmpeg_error(int errnum) {
     char buf[AV_ERROR_MAX_STRING_SIZE];
     av_strerror(errnum, buf, sizeof(buf));
@@ -20,11 +55,85 @@ int VideoDecoderBase::get_width() const { return video_stream->codecpar->width;
 int VideoDecoderBase::get_height() const { return video_stream->codecpar->height; }
 int VideoDecoderBase::get_pixel_format() const { return video_stream->codecpar->format; }
 AVRational VideoDecoderBase::get_frame_rate() const { return video_stream->avg_frame_rate; }
+AVRational VideoDecoderBase::get_time_base() const { return video_stream->time_base; }
 double VideoDecoderBase::get_duration() const { return duration; }
 double VideoDecoderBase::get_frame_time() const { return static_cast<double>(frame_pts) * av_q2d(video_stream->time_base); }
 double VideoDecoderBase::get_progress() const { return get_frame_time() / duration; }
 AVFrame* VideoDecoderBase::get_raw_frame() const { return frame.get(); }
 bool VideoDecoderBase::is_end_of_stream() const { return end_of_stream; }
+bool VideoDecoderBase::is_live() const { return live.has_value(); }
+int64_t VideoDecoderBase::get_dropped_frames() const { return dropped_frames; }
+double VideoDecoderBase::get_latency() const { return latency; }
+const std::shared_ptr<FramePool> &VideoDecoderBase::get_frame_pool() const { return frame_pool; }
+
+void VideoDecoderBase::open_input() {
+    int ret = 0;
+
+    AVDictionary* options = nullptr;
+    if (live) {
+        av_dict_set(&options, "fflags", "nobuffer", 0);
+        av_dict_set_int(&options, "probesize", live->probe_size, 0);
+        av_dict_set_int(&options, "analyzeduration", live->analyze_duration, 0);
+    }
+
+    AVFormatContext* raw_fmt_ctx = nullptr;
+    ret = avformat_open_input(&raw_fmt_ctx, filename.c_str(), nullptr, &options);
+    av_dict_free(&options);
+    if (ret < 0)
+        throw std::runtime_error("Could not open input file '" + filename + "': " + ffmpeg_error(ret));
+    format_context.reset(raw_fmt_ctx);
+
+    if ((ret = avformat_find_stream_info(format_context.get(), nullptr)) < 0)
+        throw std::runtime_error("Could not find stream info for '" + filename + "': " + ffmpeg_error(ret));
+
+    int video_stream_index = av_find_best_stream(format_context.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (video_stream_index < 0)
+        throw std::runtime_error("No suitable video stream found in file '" + filename + "'");
+
+    video_stream = format_context->streams[video_stream_index];
+    duration = (format_context->duration != AV_NOPTS_VALUE)
+                   ? static_cast<double>(format_context->duration) / AV_TIME_BASE
+                   : 0.0;
+}
+
+void VideoDecoderBase::apply_live_codec_options() {
+    if (!live)
+        return;
+
+    // output frames immediately, only if the stream has no frame reordering
+    if (video_stream->codecpar->video_delay == 0)
+        decoder_context->flags |= AV_CODEC_FLAG_LOW_DELAY;
+
+    // frame threading delays output by one frame per thread
+    decoder_context->thread_type = FF_THREAD_SLICE;
+}
+
+bool VideoDecoderBase::is_late(const int64_t pts) {
+    if (pts == AV_NOPTS_VALUE)
+        return false;
+
+    const double stream_time = static_cast<double>(pts) * av_q2d(video_stream->time_base);
+    const double wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    const double offset = wall_time - stream_time;
+    if (!clock_started || offset < clock_offset) {
+        clock_offset = offset;
+        clock_started = true;
+    }
+    latency = offset - clock_offset;
+    return latency > live->max_latency;
+}
+
+int VideoDecoderBase::get_pooled_buffer(AVCodecContext *ctx, AVFrame *frame, const int flags) {
+    const auto *self = static_cast<VideoDecoderBase *>(ctx->opaque);
+
+    int ret = AVERROR(ENOSYS);
+    if (self->frame_pool)
+        ret = self->frame_pool->get_buffer(frame, ctx);
+    if (ret == AVERROR(ENOSYS))
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    return ret;
+}
 
 double VideoDecoderBase::get_bitrate() const {
     if (bitrate_window.size() < 10) return 0.0;
@@ -39,18 +148,35 @@ double VideoDecoderBase::get_bitrate() const {
     return sum_bytes / duration;
 }
 
+std::expected<std::vector<uint8_t>, std::string> VideoDecoderBase::copy_frame_to_vector(const AVFrame *src) {
+    if (!src || !src->data[0])
+        return std::unexpected("No frame available");
+
+    if (!frame_kernels.matches(src))
+        frame_kernels = get_frame_kernels(static_cast<AVPixelFormat>(src->format), src->width, src->height);
+    if (!frame_kernels.is_valid())
+        return std::unexpected("Failed to get buffer size for frame");
+
+    TraceSpan span("get_frame_vector copy");
+    std::vector<uint8_t> buf(frame_kernels.buffer_size);
+    frame_kernels.to_buffer(frame_kernels, src, buf.data());
+    return buf;
+}
+
 void VideoDecoderBase::seek(double fraction) {
     if (!video_stream || fraction < 0.0 || fraction > 1.0)
         return;
 
     int64_t target_pts = av_rescale_q(format_context->duration * fraction,
                                       AV_TIME_BASE_Q, video_stream->time_base);
+    seek_pts(target_pts);
+}
 
-    if (av_seek_frame(format_context.get(), video_stream->index, target_pts, AVSEEK_FLAG_BACKWARD) < 0)
-        throw std::runtime_error("Error seeking to frame position");
+void VideoDecoderBase::seek_pts(const int64_t target_pts) {
+    if (!video_stream)
+        return;
 
-    avcodec_flush_buffers(decoder_context.get());
-    end_of_stream = false;
+    seek_keyframe(target_pts);
 
     // TODO use AVCodecContext skip_frames?? (skips B frames only)
     while (decode_next_frame() == 0) {
@@ -61,12 +187,93 @@ void VideoDecoderBase::seek(double fraction) {
     }
 }
 
+bool VideoDecoderBase::drop_packet() {
+    const bool key = packet->flags & AV_PKT_FLAG_KEY;
+
+    if (skip_to_keyframe) {
+        if (!key)
+            return true;
+        // resume decoding at the keyframe, frames still buffered in the decoder are stale
+        skip_to_keyframe = false;
+        avcodec_flush_buffers(decoder_context.get());
+        dropped_frames += frames_in_decoder;
+        frames_in_decoder = 0;
+    }
+
+    if (!is_late(packet->pts))
+        return false;
+
+    // nothing references these frames, they can go without decoding them (the mpegts demuxer does not set
+    // AV_PKT_FLAG_DISPOSABLE, so look at the NAL header)
+    if (packet->flags & AV_PKT_FLAG_DISPOSABLE || is_non_reference(packet.get(), video_stream->codecpar))
+        return true;
+
+    // far behind: drop the rest of the GOP
+    if (!key && latency > 4 * live->max_latency) {
+        skip_to_keyframe = true;
+        return true;
+    }
+    return false;
+}
+
+void VideoDecoderBase::seek_keyframe(const int64_t target_pts) {
+    if (av_seek_frame(format_context.get(), video_stream->index, target_pts, AVSEEK_FLAG_BACKWARD) < 0)
+        throw std::runtime_error("Error seeking to frame position");
+
+    avcodec_flush_buffers(decoder_context.get());
+    end_of_stream = false;
+    skip_to_keyframe = false;
+    frames_in_decoder = 0;
+}
+
+void VideoDecoderBase::build_index() {
+    std::unique_ptr<AVPacket, PktDeleter> pkt(av_packet_alloc());
+    if (!pkt) throw std::runtime_error("Failed to allocate AVPacket");
+
+    frame_timestamps.clear();
+    keyframe_timestamps.clear();
+
+    // demux only
+    while (av_read_frame(format_context.get(), pkt.get()) >= 0) {
+        if (pkt->stream_index == video_stream->index && pkt->pts != AV_NOPTS_VALUE) {
+            frame_timestamps.push_back(pkt->pts);
+            if (pkt->flags & AV_PKT_FLAG_KEY)
+                keyframe_timestamps.push_back(pkt->pts);
+        }
+        av_packet_unref(pkt.get());
+    }
+
+    if (keyframe_timestamps.empty())
+        throw std::runtime_error("No keyframes found in file '" + filename + "'");
+
+    std::ranges::sort(frame_timestamps);
+    std::ranges::sort(keyframe_timestamps);
+
+    // rewind
+    seek_keyframe(keyframe_timestamps.front());
+}
+
+const std::vector<int64_t> &VideoDecoderBase::get_frame_timestamps() const { return frame_timestamps; }
+const std::vector<int64_t> &VideoDecoderBase::get_keyframe_timestamps() const { return keyframe_timestamps; }
+
 int VideoDecoderBase::decode_next_frame() {
     int ret;
 
     while (true) {
-        ret = avcodec_receive_frame(decoder_context.get(), frame.get());
+        {
+            TraceSpan span("avcodec_receive_frame");
+            ret = avcodec_receive_frame(decoder_context.get(), frame.get());
+        }
         if (ret == 0) {
+            frames_in_decoder = std::max<int64_t>(0, frames_in_decoder - 1);
+
+            // too far behind, the caller would only see stale frames
+            if (live && is_late(frame->pts)) {
+                dropped_frames++;
+                av_frame_unref(frame.get());
+                continue;
+            }
+
             frame_pts = frame->pts;
             video_frame_count++;
             return 0;
@@ -86,7 +293,10 @@ int VideoDecoderBase::decode_next_frame() {
 
         // read packets until we get one for our video
         while (true) {
-            ret = av_read_frame(format_context.get(), packet.get());
+            {
+                TraceSpan span("av_read_frame");
+                ret = av_read_frame(format_context.get(), packet.get());
+            }
             if (ret == AVERROR_EOF) {
                 end_of_stream = true;
                 ret = avcodec_send_packet(decoder_context.get(), nullptr); // flush decoder
@@ -106,12 +316,22 @@ int VideoDecoderBase::decode_next_frame() {
                 if (bitrate_window.size() > max_bitrate_window)
                     bitrate_window.pop_front();
 
-                ret = avcodec_send_packet(decoder_context.get(), packet.get());
+                if (live && drop_packet()) {
+                    dropped_frames++;
+                    av_packet_unref(packet.get());
+                    continue;
+                }
+
+                {
+                    TraceSpan span("avcodec_send_packet");
+                    ret = avcodec_send_packet(decoder_context.get(), packet.get());
+                }
                 av_packet_unref(packet.get());
                 if (ret < 0) {
                     fprintf(stderr, "Error sending packet: %s\n", ffmpeg_error(ret).c_str());
                     return ret;
                 }
+                frames_in_decoder++;
                 break;
             }
 
@@ -2,6 +2,7 @@
 // Created by alex on 20.12.25.
 //
 #include "../include/encoder.h"
+#include "../include/Trace.h"
 
 #include <stdexcept>
 
@@ -9,12 +10,16 @@ VideoEncoder::VideoEncoder(
     const std::string &filename,
     const int width, const int height,
     const AVRational fps,
-    const AVPixelFormat pixelFormat):
+    const AVPixelFormat pixelFormat,
+    std::shared_ptr<FramePool> frame_pool):
         pixelFormat(pixelFormat),
+        frame_pool(std::move(frame_pool)),
         width(width),
         height(height) {
     // TODO handle pixel format
-    // TODO handle fps
+    if (fps.num <= 0 || fps.den <= 0) {
+        throw std::runtime_error("invalid frame rate");
+    }
 
     // guess output format based on filename
     if (avformat_alloc_output_context2(&output_context, nullptr, nullptr, filename.c_str()) < 0) {
@@ -56,9 +61,9 @@ VideoEncoder::VideoEncoder(
     encoder_context->width= width;
     encoder_context->height = height;
 
-    // TODO stream->time_base = AVRational{fps.den, fps.num }; // reciprocal of fps
-    stream->time_base = AVRational{1, 25 }; // reciprocal of fps
+    stream->time_base = AVRational{fps.den, fps.num }; // reciprocal of fps
     encoder_context->time_base = stream->time_base;
+    encoder_context->framerate = fps;
     encoder_context->gop_size = 12;
     encoder_context->pix_fmt = pixelFormat;
 
@@ -72,17 +77,18 @@ VideoEncoder::VideoEncoder(
         throw std::runtime_error("failed to open encoder");
     }
 
+    // select the copy kernels for the pixel format once
+    frame_kernels = get_frame_kernels(pixelFormat, width, height);
+    if (!frame_kernels.is_valid()) {
+        throw std::runtime_error("unsupported pixel format");
+    }
+
     // allocate frame and its buffers
     frame = av_frame_alloc();
     if (!frame) {
         throw std::runtime_error("failed to allocate frame");
     }
-    frame->format = pixelFormat;
-    frame->width  = width;
-    frame->height = height;
-    if (av_frame_get_buffer(frame, 0) < 0) {
-        throw std::runtime_error("failed to allocate frame data buffers");
-    }
+    _get_frame_buffer();
 
     // copy encoder context to the mux (stream)
     if (avcodec_parameters_from_context(stream->codecpar, encoder_context) < 0) {
@@ -103,6 +109,24 @@ VideoEncoder::VideoEncoder(
     }
 }
 
+int VideoEncoder::get_width() const { return width; }
+int VideoEncoder::get_height() const { return height; }
+AVPixelFormat VideoEncoder::get_pixel_format() const { return pixelFormat; }
+AVRational VideoEncoder::get_time_base() const { return encoder_context->time_base; }
+
+void VideoEncoder::_get_frame_buffer() {
+    // drop the reference to the last frame, the encoder may still hold on to it
+    av_frame_unref(frame);
+    frame->format = pixelFormat;
+    frame->width  = width;
+    frame->height = height;
+
+    const int ret = frame_pool ? frame_pool->get_buffer(frame) : av_frame_get_buffer(frame, 0);
+    if (ret < 0) {
+        throw std::runtime_error(std::string("failed to allocate frame data buffers: ") + av_err2str(ret));
+    }
+}
+
 void VideoEncoder::_gen_frame() {
     if (av_frame_make_writable(frame)) {
         throw std::runtime_error("failed to make frame writeable");
@@ -157,24 +181,61 @@ void VideoEncoder::encode_frame_synthetic() {
 
 void VideoEncoder::encode_frame(const std::vector<uint8_t> &image_buf) {
     // ensure image_buf size
-    int buf_size = av_image_get_buffer_size(pixelFormat, width, height, 1);
-    if (image_buf.size() != buf_size) {
+    if (image_buf.size() != frame_kernels.buffer_size) {
         throw std::runtime_error("image buffer has wrong size!");
     }
-    // put image into frame (copying should not be necessary, right?)
-    av_image_fill_arrays(frame->data, frame->linesize, image_buf.data(), pixelFormat, width, height, 1);
+    if (frame_pool) {
+        // copy into a fresh pooled buffer, the encoder may keep references to frames it was sent
+        _get_frame_buffer();
+        frame_kernels.from_buffer(frame_kernels, image_buf.data(), frame);
+    } else {
+        // put image into frame (copying should not be necessary, right?)
+        frame_kernels.fill_arrays(frame_kernels, image_buf.data(), frame->data, frame->linesize);
+    }
 
     frame->pts = next_pts++;
 
     // encode frame
-    if (avcodec_send_frame(encoder_context, frame)) {
+    int ret;
+    {
+        TraceSpan span("avcodec_send_frame");
+        ret = avcodec_send_frame(encoder_context, frame);
+    }
+    if (ret) {
         throw std::runtime_error("failed to send frame");
     }
 
+    _write_packets();
+}
+
+void VideoEncoder::encode_frame(const AVFrame *av_frame) {
+    if (av_frame->format != pixelFormat || av_frame->width != width || av_frame->height != height) {
+        throw std::runtime_error("frame does not match the encoder format");
+    }
+
+    // the encoder takes its own reference
+    int ret;
+    {
+        TraceSpan span("avcodec_send_frame");
+        ret = avcodec_send_frame(encoder_context, av_frame);
+    }
+    if (ret) {
+        throw std::runtime_error("failed to send frame");
+    }
+    next_pts = av_frame->pts + 1;
+
+    _write_packets();
+}
+
+void VideoEncoder::_write_packets() {
     // frame may end up as multiple packets
     while (true) {
         // receive encoded frame
-        const int ret = avcodec_receive_packet(encoder_context, packet);
+        int ret;
+        {
+            TraceSpan span("avcodec_receive_packet");
+            ret = avcodec_receive_packet(encoder_context, packet);
+        }
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
             break;
         } else if (ret < 0) {
@@ -186,6 +247,7 @@ void VideoEncoder::encode_frame(const std::vector<uint8_t> &image_buf) {
         packet->stream_index = stream->index;
 
         // write and unref the packet
+        TraceSpan span("av_interleaved_write_frame");
         if (av_interleaved_write_frame(output_context, packet) < 0) {
             throw std::runtime_error("failed to write frame");
         }
@@ -199,7 +261,10 @@ void VideoEncoder::flush_encoder() {
     }
 
     while (true) {
-        ret = avcodec_receive_packet(encoder_context, packet);
+        {
+            TraceSpan span("avcodec_receive_packet");
+            ret = avcodec_receive_packet(encoder_context, packet);
+        }
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
             break;
         } else if (ret < 0) {
@@ -211,6 +276,7 @@ void VideoEncoder::flush_encoder() {
         packet->stream_index = stream->index;
 
         // write and unref the packet
+        TraceSpan span("av_interleaved_write_frame");
         if (av_interleaved_write_frame(output_context, packet) < 0) {
             throw std::runtime_error("failed to write frame");
         }